@@ -0,0 +1,308 @@
+#!/usr/bin/env python3
+#
+# widl corpus regression check
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+#
+# --------------------------------------------------------------------------------------
+#
+# Compiles the hand written IDL files in corpus/ with every output kind
+# they are meant for, and compares the result with corpus/expected.json:
+# each output must hash to the same SHA-256 as the one the widl from
+# before the performance work generated, so that speeding up widl never
+# changes what it generates.
+#
+# With --baseline, a second widl, typically a build of that older tree,
+# compiles every case in the same run, and the best wall time and peak
+# RSS of the widl under test must stay within the given factors of its
+# ones.  The runs of the two alternate so that both see the same load.
+#
+# The corpus is copied to a work directory and compiled from there with
+# relative file names, and typelibs get a fixed timestamp, so that the
+# outputs do not depend on where or when the check runs.  After an
+# intended change of the outputs, record them again:
+#
+#   check_corpus.py --widl ./widl --update
+#
+# Batch cases compile some of the cases above with a single --batch run,
+# which shares the parsed imports between them; each output must hash the
+# same as when its case is compiled alone.  With --baseline, the batch must
+# not take longer than the baseline compiling the cases one by one.
+#
+# The old typelib writer does not handle most of what the corpus uses, so
+# it only compiles the oldtlb inputs.  The second library block of
+# oldtlb.idl is the one that ends up in the output.  oldtlb_names.idl
+# repeats names and help strings, which are stored once since the name
+# table was shared; its output was recorded after that change.
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from widl_bench import has_stats, run_widl
+
+CORPUS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "corpus")
+EXPECTED = os.path.join(CORPUS, "expected.json")
+
+WIN32 = ["-b", "i686-windows"]
+WIN64 = ["-b", "x86_64-windows"]
+WINRT = ["--winrt", "--ns_prefix"]
+
+# name, input, options, output
+CASES = [
+    ("common-header",     "common.idl",  ["-h"],                        "common.h"),
+    ("com-header",        "com.idl",     ["-h"],                        "com.h"),
+    ("com-proxy-win32",   "com.idl",     WIN32 + ["-p"],                "com_p32.c"),
+    ("com-proxy-win64",   "com.idl",     WIN64 + ["-p"],                "com_p64.c"),
+    ("com-proxy-oi",      "com.idl",     WIN32 + ["-Oi", "-p"],         "com_poi.c"),
+    ("com-iid",           "com.idl",     ["-u"],                        "com_i.c"),
+    ("rpc-header",        "rpc.idl",     ["--acf=rpc.acf", "-h"],       "rpc.h"),
+    ("rpc-client-win32",  "rpc.idl",     ["--acf=rpc.acf"] + WIN32 + ["-c"], "rpc_c32.c"),
+    ("rpc-client-win64",  "rpc.idl",     ["--acf=rpc.acf"] + WIN64 + ["-c"], "rpc_c64.c"),
+    ("rpc-server-win32",  "rpc.idl",     ["--acf=rpc.acf"] + WIN32 + ["-s"], "rpc_s32.c"),
+    ("rpc-server-win64",  "rpc.idl",     ["--acf=rpc.acf"] + WIN64 + ["-s"], "rpc_s64.c"),
+    ("rpc-server-os",     "rpc.idl",     ["--acf=rpc.acf"] + WIN32 + ["-Os", "-s"], "rpc_sos.c"),
+    ("typelib-header",    "typelib.idl", ["-h"],                        "typelib.h"),
+    ("typelib-tlb-win32", "typelib.idl", WIN32 + ["-t"],                "typelib32.tlb"),
+    ("typelib-tlb-win64", "typelib.idl", WIN64 + ["-t"],                "typelib64.tlb"),
+    ("typelib-proxy",     "typelib.idl", WIN64 + ["-p"],                "typelib_p.c"),
+    ("typelib-regscript", "typelib.idl", ["-r"],                        "typelib_r.rgs"),
+    ("oldtlb-win32",      "oldtlb.idl",  WIN32 + ["--oldtlb", "-t"],    "oldtlb32.tlb"),
+    ("oldtlb-win64",      "oldtlb.idl",  WIN64 + ["--oldtlb", "-t"],    "oldtlb64.tlb"),
+    ("oldtlb-names",      "oldtlb_names.idl", WIN64 + ["--oldtlb", "-t"], "oldtlb_names.tlb"),
+    ("winrt-header",      "winrt.idl",   WINRT + ["-h"],                "winrt.h"),
+    ("winrt-proxy",       "winrt.idl",   WINRT + WIN64 + ["-p"],        "winrt_p.c"),
+    ("winrt-iid",         "winrt.idl",   WINRT + ["-u"],                "winrt_i.c"),
+    ("forward-header",    "forward_def.idl", WIN64 + ["-h"],            "forward_def.h"),
+    ("forward-proxy",     "forward_def.idl", WIN64 + ["-p"],            "forward_def_p.c"),
+    ("forward-use",       "forward_use.idl", WIN64 + ["-h"],            "forward_use.h"),
+    ("pickle-client",     "pickle_rpc.idl", WIN64 + ["--acf=pickle_rpc.acf", "-c"], "pickle_rpc_c.c"),
+    ("pickle-use-client", "pickle_use.idl", WIN64 + ["-c"],             "pickle_use_c.c"),
+    ("pickle-use-header", "pickle_use.idl", WIN64 + ["-h"],             "pickle_use.h"),
+]
+
+# name, options of the whole batch, cases it compiles in order; the options
+# of each case start with the ones of the batch
+BATCH_CASES = [
+    ("forward-batch",     WIN64,         ["forward-header", "forward-proxy", "forward-use"]),
+    ("oldtlb-batch",      WIN64,         ["oldtlb-win64", "oldtlb-win64"]),
+    ("pickle-batch",      WIN64,         ["pickle-client", "pickle-use-client", "pickle-use-header", "pickle-client"]),
+]
+
+
+def hash_file(name):
+    sha = hashlib.sha256()
+    with open(name, "rb") as f:
+        for block in iter(lambda: f.read(65536), b""):
+            sha.update(block)
+    return sha.hexdigest()
+
+
+def compare_runs(runs, options, input_name, output, repeat):
+    """best wall time and peak RSS of each (widl, directory) of runs; the
+    RSS is only known when all of them have --stats, the ru_maxrss of a
+    child mostly measures this script"""
+    walls = [None] * len(runs)
+    rss = [None] * len(runs)
+    for _ in range(max(repeat, 1)):
+        for i, (widl, cwd) in enumerate(runs):
+            wall = run_widl(widl, options, input_name, output, cwd=cwd)[0]
+            if walls[i] is None or wall < walls[i]:
+                walls[i] = wall
+    if all(has_stats(widl) for widl, _ in runs):
+        rss = [run_widl(widl, options, input_name, output, stats=True, cwd=cwd)[2] for widl, cwd in runs]
+    return walls, rss
+
+
+def run_batch(widl, options, entries, name, cwd):
+    """compile the (input, options, output) entries with one --batch run of
+    widl, returns the wall time"""
+    batch = os.path.join(cwd, name + ".batch")
+    with open(batch, "w") as f:
+        for input_name, entry_options, output in entries:
+            f.write(" ".join(entry_options + ["-o", output, input_name]) + "\n")
+            if os.path.exists(os.path.join(cwd, output)):
+                os.unlink(os.path.join(cwd, output))
+    env = dict(os.environ)
+    env.pop("WIDL_SERVER", None)
+    cmd = [widl] + options + ["--batch=" + batch]
+    with tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        ret = subprocess.call(cmd, stdout=subprocess.DEVNULL, stderr=err, env=env, cwd=cwd)
+        wall = time.perf_counter() - start
+        err.seek(0)
+        if ret:
+            raise RuntimeError("%s failed:\n%s" % (" ".join(cmd), err.read().decode(errors="replace")))
+    for _, _, output in entries:
+        if not os.path.exists(os.path.join(cwd, output)):
+            raise RuntimeError("%s did not write %s" % (" ".join(cmd), output))
+    return wall
+
+
+def check_batch(args, runs, expected, name, options, case_names):
+    """run a batch case, returns whether it failed"""
+    cases = dict((case[0], case[1:]) for case in CASES)
+    entries = []
+    for case in case_names:
+        input_name, case_options, output = cases[case]
+        assert case_options[:len(options)] == options
+        entries.append((input_name, case_options[len(options):], output))
+
+    walls = [None, None]
+    try:
+        for _ in range(max(args.repeat if args.baseline else 1, 1)):
+            wall = run_batch(runs[0][0], options, entries, name, runs[0][1])
+            if walls[0] is None or wall < walls[0]:
+                walls[0] = wall
+            if args.baseline:
+                widl, cwd = runs[1]
+                wall = sum(run_widl(widl, cases[case][1], cases[case][0], cases[case][2], cwd=cwd)[0]
+                           for case in case_names)
+                if walls[1] is None or wall < walls[1]:
+                    walls[1] = wall
+    except RuntimeError as e:
+        print("%-18s %10s %10s %10s %10s  failed" % (name, "-", "-", "-", "-"))
+        print(e, file=sys.stderr)
+        return True
+
+    problems = []
+    for case, (_, _, output) in zip(case_names, entries):
+        if case not in expected:
+            problems.append("%s not recorded" % case)
+        elif expected[case]["sha256"] != hash_file(os.path.join(runs[0][1], output)):
+            problems.append("%s changed" % output)
+    if args.baseline and walls[0] > walls[1] * args.max_time + args.slack:
+        problems.append("%.2fx slower" % (walls[0] / walls[1]))
+    print("%-18s %10.4f %10s %10s %10s  %s" % (name, walls[0],
+                                               format_value(walls[1], "%.4f"), "-", "-",
+                                               ", ".join(problems) if problems else "ok"))
+    return bool(problems)
+
+
+def format_value(value, fmt):
+    return fmt % value if value is not None else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check widl outputs and performance on the IDL corpus.")
+    parser.add_argument("--widl", help="widl executable to check")
+    parser.add_argument("--baseline", help="widl executable to compare the time and memory use with")
+    parser.add_argument("--outdir", default="widl-check", help="work directory (default widl-check)")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="runs per case and widl with --baseline, the best is kept (default 5)")
+    parser.add_argument("--cases", help="comma separated cases to run (default all)")
+    parser.add_argument("--list", action="store_true", help="list the cases and exit")
+    parser.add_argument("--max-time", type=float, default=1.5,
+                        help="fail if a case takes longer than this factor of the baseline time (default 1.5)")
+    parser.add_argument("--max-rss", type=float, default=1.2,
+                        help="fail if a case uses more than this factor of the baseline peak RSS (default 1.2)")
+    parser.add_argument("--slack", type=float, default=0.010,
+                        help="seconds a case may always take on top of the baseline time (default 0.010)")
+    parser.add_argument("--update", action="store_true", help="record the outputs instead of checking them")
+    args = parser.parse_args()
+
+    if args.list:
+        for case in CASES + BATCH_CASES:
+            print(case[0])
+        return 0
+    if not args.widl:
+        parser.error("--widl is required")
+
+    widl = os.path.abspath(args.widl)
+    work = os.path.abspath(args.outdir)
+    if os.path.exists(work):
+        shutil.rmtree(work)
+    shutil.copytree(CORPUS, work, ignore=shutil.ignore_patterns("expected.json"))
+    runs = [(widl, work)]
+    if args.baseline:
+        shutil.copytree(CORPUS, os.path.join(work, "baseline"), ignore=shutil.ignore_patterns("expected.json"))
+        runs.append((os.path.abspath(args.baseline), os.path.join(work, "baseline")))
+        if has_stats(runs[0][0]) != has_stats(runs[1][0]):
+            print("note: one widl has no --stats, not comparing the memory use", file=sys.stderr)
+
+    expected = {}
+    if not args.update:
+        with open(EXPECTED) as f:
+            expected = json.load(f)["cases"]
+
+    wanted = args.cases.split(",") if args.cases else None
+    os.environ["WIDL_TIME_OVERRIDE"] = "0"
+
+    results = {}
+    failed = False
+    print("%-18s %10s %10s %10s %10s  %s" % ("case", "wall (s)", "base (s)", "rss (KiB)", "base", "result"))
+    for name, input_name, options, output in CASES:
+        if wanted and name not in wanted:
+            continue
+        try:
+            walls, rss = compare_runs(runs, options, input_name, output, args.repeat if args.baseline else 1)
+        except RuntimeError as e:
+            print("%-18s %10s %10s %10s %10s  failed" % (name, "-", "-", "-", "-"))
+            print(e, file=sys.stderr)
+            failed = True
+            continue
+
+        entry = {"sha256": hash_file(os.path.join(work, output))}
+        results[name] = entry
+
+        problems = []
+        base = expected.get(name)
+        if args.update:
+            pass
+        elif not base:
+            problems.append("not recorded")
+        elif base["sha256"] != entry["sha256"]:
+            problems.append("output changed")
+        if args.baseline:
+            if walls[0] > walls[1] * args.max_time + args.slack:
+                problems.append("%.2fx slower" % (walls[0] / walls[1]))
+            if rss[0] and rss[1] and rss[0] > rss[1] * args.max_rss:
+                problems.append("%.2fx more memory" % (rss[0] / rss[1]))
+        if problems:
+            failed = True
+        print("%-18s %10.4f %10s %10s %10s  %s" % (name, walls[0],
+                                                   format_value(walls[1] if args.baseline else None, "%.4f"),
+                                                   format_value(rss[0], "%d"),
+                                                   format_value(rss[1] if args.baseline else None, "%d"),
+                                                   ", ".join(problems) if problems else "ok"))
+
+    # the outputs of the batch cases are recorded with their single cases
+    for name, options, case_names in BATCH_CASES:
+        if args.update or (wanted and name not in wanted):
+            continue
+        if check_batch(args, runs, expected, name, options, case_names):
+            failed = True
+
+    if args.update:
+        if wanted:
+            with open(EXPECTED) as f:
+                recorded = json.load(f)["cases"]
+            recorded.update(results)
+            results = recorded
+        with open(EXPECTED, "w") as f:
+            json.dump({"cases": results}, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("recorded %s" % EXPECTED)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+#
+# Synthetic IDL generator for the widl benchmarks
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+#
+# --------------------------------------------------------------------------------------
+#
+# Writes a self-contained set of IDL files whose size is controlled from the
+# command line, so that the cost of each part of widl can be measured as the
+# input grows:
+#
+#   bench_base.idl      basic types, IUnknown and IDispatch
+#   bench_import<k>.idl a chain of imports, each one importing the previous
+#   bench.idl           the main file: big enums, nested and conformant
+#                       structs, unions, RPC interfaces, object interfaces
+#                       with deep inheritance, and a library holding
+#                       dispinterfaces and coclasses
+#
+# The output only depends on the parameters, so results of different widl
+# builds can be compared.
+
+import argparse
+import os
+
+
+def guid(kind, index):
+    return "%08x-%04x-4000-8000-%012x" % (0x5e1f0000 + index, kind, index)
+
+
+BASE_IDL = """\
+typedef long HRESULT;
+typedef long LONG;
+typedef unsigned long ULONG;
+typedef unsigned long DWORD;
+typedef unsigned short WORD;
+typedef unsigned char BYTE;
+typedef short VARIANT_BOOL;
+typedef double DATE;
+typedef wchar_t WCHAR;
+typedef WCHAR OLECHAR;
+typedef [string] WCHAR *LPWSTR;
+typedef OLECHAR *BSTR;
+typedef struct _GUID { DWORD Data1; WORD Data2; WORD Data3; BYTE Data4[8]; } GUID;
+typedef GUID IID;
+typedef GUID CLSID;
+typedef IID *REFIID;
+typedef DWORD LCID;
+typedef long DISPID;
+
+[object, local, uuid(00000000-0000-0000-C000-000000000046), pointer_default(unique)]
+interface IUnknown
+{
+    HRESULT QueryInterface([in] REFIID riid, [out, iid_is(riid)] void **ppv);
+    ULONG AddRef();
+    ULONG Release();
+}
+
+[object, local, uuid(00020400-0000-0000-C000-000000000046), pointer_default(unique)]
+interface IDispatch : IUnknown
+{
+    HRESULT GetTypeInfoCount([out] unsigned int *count);
+    HRESULT GetIDsOfNames([in] REFIID riid, [in, size_is(count)] LPWSTR *names,
+                          [in] unsigned int count, [in] LCID lcid,
+                          [out, size_is(count)] DISPID *ids);
+}
+"""
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.files = {}
+
+    def write(self, name, lines):
+        self.files[name] = "\n".join(lines) + "\n"
+
+    def gen_imports(self):
+        """a chain of imports, each adding a few types and an interface"""
+        prev = "bench_base.idl"
+        for k in range(self.args.imports):
+            name = "bench_import%d.idl" % k
+            out = ['import "%s";' % prev, ""]
+            out.append("typedef enum tagIMPORT%d_ENUM { IMPORT%d_A, IMPORT%d_B = %d } IMPORT%d_ENUM;"
+                       % (k, k, k, k + 1, k))
+            out.append("typedef struct tagIMPORT%d_STRUCT { LONG value; IMPORT%d_ENUM kind; } IMPORT%d_STRUCT;"
+                       % (k, k, k))
+            out.append("")
+            out.append("[object, uuid(%s), pointer_default(unique)]" % guid(1, k))
+            out.append("interface IImport%d : IUnknown" % k)
+            out.append("{")
+            out.append("    HRESULT Get%d([out] IMPORT%d_STRUCT *value);" % (k, k))
+            if k:
+                out.append("    HRESULT Chain%d([in] IImport%d *prev);" % (k, k - 1))
+            out.append("}")
+            self.write(name, out)
+            prev = name
+        return prev
+
+    def gen_enums(self, out):
+        for e in range(self.args.enums):
+            out.append("typedef enum tagBENCH_ENUM%d" % e)
+            out.append("{")
+            values = ["    BENCH%d_VALUE%d = %d" % (e, v, v * 2 + e) for v in range(self.args.enum_values)]
+            out.append(",\n".join(values))
+            out.append("} BENCH_ENUM%d;" % e)
+            out.append("")
+
+    def gen_structs(self, out):
+        """nested structs, conformant structs and unions for the RPC interfaces"""
+        for s in range(self.args.structs):
+            kind = "BENCH_ENUM%d" % (s % self.args.enums) if self.args.enums else "LONG"
+            out.append("typedef struct tagINNER%d" % s)
+            out.append("{")
+            out.append("    short s;")
+            out.append("    LONG l[%d];" % (s % 4 + 1))
+            out.append("    double d;")
+            out.append("} INNER%d;" % s)
+            out.append("")
+            out.append("typedef struct tagNESTED%d" % s)
+            out.append("{")
+            out.append("    INNER%d inner;" % s)
+            if s:
+                out.append("    struct tagNESTED%d *prev;" % (s - 1))
+            out.append("    [string] WCHAR *name;")
+            out.append("    %s kind;" % kind)
+            out.append("} NESTED%d;" % s)
+            out.append("")
+            out.append("typedef struct tagCONFORMANT%d" % s)
+            out.append("{")
+            out.append("    DWORD count;")
+            out.append("    NESTED%d header;" % s)
+            out.append("    [size_is(count)] INNER%d items[];" % s)
+            out.append("} CONFORMANT%d;" % s)
+            out.append("")
+            out.append("typedef [switch_type(DWORD)] union tagUNION%d" % s)
+            out.append("{")
+            out.append("    [case(0)] LONG l;")
+            out.append("    [case(1)] INNER%d inner;" % s)
+            out.append("    [case(2)] NESTED%d *nested;" % s)
+            out.append("    [default] ;")
+            out.append("} UNION%d;" % s)
+            out.append("")
+            out.append("typedef struct tagENCAPSULATED%d" % s)
+            out.append("{")
+            out.append("    DWORD tag;")
+            out.append("    [switch_is(tag)] UNION%d u;" % s)
+            out.append("} ENCAPSULATED%d;" % s)
+            out.append("")
+
+    def gen_rpc_interfaces(self, out):
+        structs = max(self.args.structs, 1)
+        for i in range(self.args.rpc_interfaces):
+            out.append("[uuid(%s), version(1.0), pointer_default(unique)]" % guid(2, i))
+            out.append("interface IBenchRpc%d" % i)
+            out.append("{")
+            for m in range(self.args.methods):
+                s = (i + m) % structs
+                if not self.args.structs:
+                    out.append("    LONG Rpc%d_%d([in] handle_t h, [in] LONG value, [out] LONG *result);" % (i, m))
+                elif m % 3 == 0:
+                    out.append("    LONG Rpc%d_%d([in] handle_t h, [in] DWORD count, [in, size_is(count)] INNER%d *items, [out] NESTED%d *result);"
+                               % (i, m, s, s))
+                elif m % 3 == 1:
+                    out.append("    LONG Rpc%d_%d([in] handle_t h, [in] CONFORMANT%d *data, [in, out, unique] ENCAPSULATED%d *u);"
+                               % (i, m, s, s))
+                else:
+                    out.append("    LONG Rpc%d_%d([in] handle_t h, [in] DWORD tag, [in, switch_is(tag)] UNION%d *u, [out, string] WCHAR **name);"
+                               % (i, m, s))
+            out.append("}")
+            out.append("")
+
+    def gen_object_interfaces(self, out, last_import):
+        """object interfaces, each one inheriting from the previous one of its chain"""
+        depth = max(self.args.depth, 1)
+        for i in range(self.args.interfaces):
+            base = "IBench%d" % (i - 1) if i % depth else "IUnknown"
+            out.append("[object, uuid(%s), oleautomation, pointer_default(unique)]" % guid(3, i))
+            out.append("interface IBench%d : %s" % (i, base))
+            out.append("{")
+            for m in range(self.args.methods):
+                if m % 4 == 0:
+                    out.append("    HRESULT Method%d_%d([in] LONG value, [in] BSTR name, [out, retval] LONG *result);" % (i, m))
+                elif m % 4 == 1:
+                    out.append("    HRESULT Method%d_%d([in] double value, [in] VARIANT_BOOL flag, [out] DATE *date, [out, retval] BSTR *name);" % (i, m))
+                elif m % 4 == 2:
+                    out.append("    HRESULT Method%d_%d([in] IBench%d *self, [out, retval] IUnknown **result);" % (i, m, i))
+                elif self.args.sltg or not last_import:
+                    out.append("    HRESULT Method%d_%d([in] DWORD count, [out] LONG *info);" % (i, m))
+                else:
+                    out.append("    HRESULT Method%d_%d([in] DWORD count, [in, size_is(count)] LONG *values, [out] IMPORT%d_STRUCT *info);"
+                               % (i, m, self.args.imports - 1))
+            out.append("}")
+            out.append("")
+
+    def gen_library(self, out, interfaces):
+        out.append("[uuid(%s), version(1.0), helpstring(\"widl benchmark library\")]" % guid(4, 0))
+        out.append("library BenchLib")
+        out.append("{")
+        if self.args.sltg:
+            # the SLTG writer only handles interfaces defined in the library
+            out.extend(interfaces)
+            out.append("}")
+            return
+        for d in range(self.args.dispinterfaces):
+            out.append("    [uuid(%s), helpstring(\"dispinterface %d\")]" % (guid(5, d), d))
+            out.append("    dispinterface DBench%d" % d)
+            out.append("    {")
+            out.append("    properties:")
+            for p in range(max(self.args.methods // 4, 1)):
+                out.append("        [id(%d)] LONG Prop%d_%d;" % (p + 1, d, p))
+            out.append("    methods:")
+            for m in range(self.args.methods):
+                out.append("        [id(%d)] HRESULT Invoke%d_%d([in] LONG value, [in] BSTR name);" % (m + 100, d, m))
+            out.append("    }")
+            out.append("")
+        for c in range(self.args.coclasses):
+            out.append("    [uuid(%s)]" % guid(6, c))
+            out.append("    coclass Bench%d" % c)
+            out.append("    {")
+            if self.args.interfaces:
+                out.append("        [default] interface IBench%d;" % (c % self.args.interfaces))
+                if self.args.interfaces > 1:
+                    out.append("        interface IBench%d;" % ((c + 1) % self.args.interfaces))
+            if self.args.dispinterfaces:
+                out.append("        [source] dispinterface DBench%d;" % (c % self.args.dispinterfaces))
+            out.append("    }")
+            out.append("")
+        out.append("}")
+
+    def generate(self):
+        self.write("bench_base.idl", BASE_IDL.splitlines())
+        last_import = self.gen_imports() if self.args.imports else None
+        out = ['import "%s";' % (last_import or "bench_base.idl")]
+        out.append("")
+        self.gen_enums(out)
+        self.gen_structs(out)
+        self.gen_rpc_interfaces(out)
+        interfaces = []
+        self.gen_object_interfaces(interfaces, last_import)
+        if not self.args.sltg:
+            out.extend(interfaces)
+        self.gen_library(out, interfaces)
+        self.write("bench.idl", out)
+        return self.files
+
+
+def add_arguments(parser):
+    parser.add_argument("--interfaces", type=int, default=64, help="object interfaces (default 64)")
+    parser.add_argument("--methods", type=int, default=16, help="methods per interface (default 16)")
+    parser.add_argument("--depth", type=int, default=8, help="length of the inheritance chains (default 8)")
+    parser.add_argument("--enums", type=int, default=4, help="enums (default 4)")
+    parser.add_argument("--enum-values", type=int, default=256, help="values per enum (default 256)")
+    parser.add_argument("--structs", type=int, default=16, help="groups of nested/conformant structs and unions (default 16)")
+    parser.add_argument("--rpc-interfaces", type=int, default=8, help="RPC interfaces (default 8)")
+    parser.add_argument("--imports", type=int, default=8, help="length of the import chain (default 8)")
+    parser.add_argument("--dispinterfaces", type=int, default=16, help="dispinterfaces in the library (default 16)")
+    parser.add_argument("--coclasses", type=int, default=16, help="coclasses in the library (default 16)")
+    parser.add_argument("--sltg", action="store_true",
+                        help="only put what the old typelib (SLTG) writer supports in the library")
+
+
+def generate(args, outdir):
+    """write the IDL files to outdir, returns the path of the main file"""
+    os.makedirs(outdir, exist_ok=True)
+    for name, text in Generator(args).generate().items():
+        path = os.path.join(outdir, name)
+        # leave unchanged files alone, so that widl's import cache stays valid
+        try:
+            with open(path) as f:
+                if f.read() == text:
+                    continue
+        except OSError:
+            pass
+        with open(path, "w") as f:
+            f.write(text)
+    return os.path.join(outdir, "bench.idl")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate synthetic IDL for benchmarking widl.")
+    parser.add_argument("-o", "--outdir", default=".", help="output directory (default .)")
+    add_arguments(parser)
+    args = parser.parse_args()
+    print(generate(args, args.outdir))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+#
+# widl benchmark driver
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+#
+# --------------------------------------------------------------------------------------
+#
+# Generates the synthetic corpus with genidl.py, then runs widl over it once
+# per output kind and records the wall and CPU time, the peak RSS and the
+# size of the output.  The results are written as JSON, and can be compared
+# with those of an earlier run, for instance of another widl build:
+#
+#   widl_bench.py --widl ./widl --results before.json
+#   widl_bench.py --widl ./widl --baseline before.json
+#
+# The old typelib writer does not handle everything the other outputs are
+# tested with, so --oldtlb runs on a corpus generated with --sltg.
+#
+# The peak RSS comes from widl --stats.  A widl older than that option is
+# measured by the ru_maxrss of its process instead, which also counts the
+# memory of this script; the two are not compared with each other.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+import genidl
+
+KINDS = [
+    ("header",  ["-h"],              False),
+    ("proxy",   ["-p"],              False),
+    ("client",  ["-c"],              False),
+    ("server",  ["-s"],              False),
+    ("typelib", ["-t"],              False),
+    ("oldtlb",  ["-t", "--oldtlb"],  True),
+]
+
+
+_stats_support = {}
+
+
+def has_stats(widl):
+    """whether widl knows --stats, older ones reject it"""
+    if widl not in _stats_support:
+        proc = subprocess.run([widl, "--stats", "-V"], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        _stats_support[widl] = proc.returncode == 0
+    return _stats_support[widl]
+
+
+def run_widl(widl, args, input_name, output, stats=False, cwd=None):
+    """run widl once, returns (wall, cpu, peak RSS in KiB or None)
+
+    With stats the peak RSS is taken from the --stats output.  Otherwise it
+    is the ru_maxrss of the child, which also counts the memory of this
+    script, so it is only an upper bound."""
+    env = dict(os.environ)
+    env.pop("WIDL_SERVER", None)  # always compile in process
+    cmd = [widl] + (["--stats"] if stats else []) + args + ["-o", output, input_name]
+    output_path = os.path.join(cwd, output) if cwd else output
+    if os.path.exists(output_path):
+        os.unlink(output_path)
+
+    with tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=err, env=env, cwd=cwd)
+        if hasattr(os, "wait4"):
+            _, status, usage = os.wait4(proc.pid, 0)
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            cpu = usage.ru_utime + usage.ru_stime
+            rss = usage.ru_maxrss
+        else:
+            proc.wait()
+            cpu = rss = None
+        wall = time.perf_counter() - start
+        err.seek(0)
+        messages = err.read().decode(errors="replace")
+        if proc.returncode:
+            raise RuntimeError("%s failed:\n%s" % (" ".join(cmd), messages))
+    if not os.path.exists(output_path):
+        raise RuntimeError("%s did not write %s" % (" ".join(cmd), output))
+    match = re.search(r"^Peak RSS: (\d+) KiB, (\d+) KiB", messages, re.M)
+    if stats:
+        rss = max(int(match.group(1)), int(match.group(2))) if match else None
+    return wall, cpu, rss
+
+
+def rss_source(widl):
+    """how best_run measures the peak RSS of widl"""
+    return "stats" if has_stats(widl) else "ru_maxrss"
+
+
+def best_run(widl, args, input_name, output, repeat):
+    """the fastest of repeat runs, along with the peak RSS of an extra --stats
+    one, or the lowest ru_maxrss of the runs when widl has no --stats"""
+    best = None
+    rss = None
+    for _ in range(max(repeat, 1)):
+        run = run_widl(widl, args, input_name, output)
+        if best is None or run[0] < best[0]:
+            best = run
+        if run[2] is not None and (rss is None or run[2] < rss):
+            rss = run[2]
+    if has_stats(widl):
+        rss = run_widl(widl, args, input_name, output, stats=True)[2]
+    return best[0], best[1], rss
+
+
+def format_value(value, fmt):
+    return fmt % value if value is not None else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark widl on synthetic IDL.")
+    parser.add_argument("--widl", required=True, help="widl executable to benchmark")
+    parser.add_argument("--outdir", default="widl-bench", help="work directory (default widl-bench)")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per output kind, the best is kept (default 3)")
+    parser.add_argument("--kinds", default=",".join(k[0] for k in KINDS),
+                        help="comma separated output kinds to run (default all)")
+    parser.add_argument("--results", help="write the results to this JSON file (default <outdir>/results.json)")
+    parser.add_argument("--baseline", help="compare with the results of an earlier run")
+    genidl.add_arguments(parser)
+    args = parser.parse_args()
+
+    widl = os.path.abspath(args.widl)
+    args.sltg = False
+    corpus = genidl.generate(args, os.path.join(args.outdir, "corpus"))
+    args.sltg = True
+    sltg_corpus = genidl.generate(args, os.path.join(args.outdir, "corpus-sltg"))
+    outputs = os.path.join(args.outdir, "out")
+    os.makedirs(outputs, exist_ok=True)
+
+    params = {name: value for name, value in vars(args).items()
+              if name not in ("widl", "outdir", "repeat", "kinds", "results", "baseline", "sltg")}
+    results = {"widl": widl, "params": params, "rss_source": rss_source(widl), "kinds": {}}
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("params") != params:
+            print("warning: the baseline was run with other parameters", file=sys.stderr)
+        compare_rss = baseline.get("rss_source") == results["rss_source"]
+        if not compare_rss:
+            print("warning: the baseline measured the peak RSS differently, not comparing it", file=sys.stderr)
+
+    failed = False
+    wanted = args.kinds.split(",")
+    print("%-8s %10s %10s %10s %12s%s" % ("output", "wall (s)", "cpu (s)", "rss (KiB)", "size",
+                                          "   wall/base rss/base" if baseline else ""))
+    for name, options, sltg in KINDS:
+        if name not in wanted:
+            continue
+        output = os.path.join(outputs, "bench." + name)
+        try:
+            wall, cpu, rss = best_run(widl, options, sltg_corpus if sltg else corpus, output, args.repeat)
+        except RuntimeError as e:
+            print("%-8s failed" % name)
+            print(e, file=sys.stderr)
+            failed = True
+            continue
+
+        entry = {"wall": wall, "cpu": cpu, "rss_kib": rss, "output_bytes": os.path.getsize(output)}
+        results["kinds"][name] = entry
+
+        line = "%-8s %10.3f %10s %10s %12d" % (name, wall, format_value(cpu, "%.3f"),
+                                               format_value(rss, "%d"), entry["output_bytes"])
+        base = baseline["kinds"].get(name) if baseline else None
+        if base:
+            line += "   %9.2f %8s" % (wall / base["wall"],
+                                      format_value(rss / base["rss_kib"] if compare_rss and rss and base["rss_kib"]
+                                                   else None, "%.2f"))
+            if base["output_bytes"] != entry["output_bytes"]:
+                line += "  (output size was %d)" % base["output_bytes"]
+        print(line)
+
+    with open(args.results or os.path.join(args.outdir, "results.json"), "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+        f.write("\n")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,53 @@
+/*
+ * Parse tree node allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_ARENA_H
+#define __WIDL_ARENA_H
+
+#include <stddef.h>
+
+struct arena;
+
+/* what a node is used for, only kept for --stats */
+enum node_kind
+{
+    NODE_TYPE,
+    NODE_TYPE_DETAILS,
+    NODE_VAR,
+    NODE_DECLARATOR,
+    NODE_EXPR,
+    NODE_ATTR,
+    NODE_STATEMENT,
+    NODE_LIST,
+    NODE_OTHER,
+    NB_NODE_KINDS
+};
+
+/* nodes of imported files, kept for the whole process */
+extern struct arena *const import_arena;
+
+extern void *node_alloc( enum node_kind kind, size_t size );
+extern void node_free( enum node_kind kind, void *ptr, size_t size );
+extern struct arena *set_node_arena( struct arena *arena );
+extern struct arena *arena_create( void );
+extern int arena_contains( const struct arena *arena, const void *ptr );
+extern void arena_release( struct arena *arena );
+extern void arena_free( struct arena *arena );
+extern void arena_dump_stats( const struct arena *input );
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Compile server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_COMPILE_SERVER_H
+#define __WIDL_COMPILE_SERVER_H
+
+/* environment variable naming the socket of a running compile server */
+#define COMPILE_SERVER_ENV "WIDL_SERVER"
+
+/* exit status of a request the server cannot handle */
+#define COMPILE_SERVER_RETRY 125
+
+extern void run_compile_server( const char *name );
+extern int run_compile_client( const char *name, int argc, char *argv[], int *status );
+
+/* implemented in widl.c */
+extern int compile_request( int argc, char *argv[] );
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Dependency file generation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_DEPFILE_H
+#define __WIDL_DEPFILE_H
+
+#include <stdio.h>
+
+extern void scan_line_markers( const char *data, size_t size,
+                               void (*add)( void *ctx, const char *name, size_t len ), void *ctx );
+extern void add_dependency( const char *name );
+extern void add_preprocessed_dependencies( const char *data, size_t size );
+extern void reset_dependencies(void);
+
+#endif
@@ -25,6 +25,9 @@
 
 extern int is_ptrchain_attr(const var_t *var, enum attr_type t);
 extern int is_aliaschain_attr(const type_t *var, enum attr_type t);
+extern int attr_lists_frozen;
+extern attr_list_t *new_attr_list(void);
+extern void attr_list_changed(attr_list_t *list);
 extern int is_attr(const attr_list_t *list, enum attr_type t);
 extern void *get_attrp(const attr_list_t *list, enum attr_type t);
 extern unsigned int get_attrv(const attr_list_t *list, enum attr_type t);
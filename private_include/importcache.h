@@ -0,0 +1,32 @@
+/*
+ * Preprocessed import cache
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_IMPORTCACHE_H
+#define __WIDL_IMPORTCACHE_H
+
+#include <stdio.h>
+
+extern char *import_cache_dir;
+
+extern void import_cache_add_key( const char *fmt, ... ) __attribute__((format (printf, 1, 2)));
+extern char *import_cache_load( const char *path, size_t *size );
+extern void import_cache_store( const char *path, const char *data, size_t size );
+extern void *import_cache_load_data( const char *key, size_t *size );
+extern void import_cache_store_data( const char *key, const void *data, size_t size );
+
+#endif
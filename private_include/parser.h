@@ -21,28 +21,87 @@
 #ifndef __WIDL_PARSER_H
 #define __WIDL_PARSER_H
 
-int parser_parse(void);
+struct arena;
+struct extended_type;
+struct import_file;
+struct imports;
+struct yy_buffer_state;
 
-extern FILE *parser_in;
-extern char *parser_text;
-extern int parser_debug;
-extern int yy_flex_debug;
+#define MAX_IMPORT_DEPTH 20
 
-int parser_lex(void);
+/* A file whose parse is suspended while one it imports is parsed */
+struct import_state
+{
+  struct yy_buffer_state *buffer;
+  char *input_name;
+  int   line_number;
+  char *data;
+  struct import_file *import;
+};
 
-extern int import_stack_ptr;
-int do_import(char *fname);
-void abort_import(void);
-void pop_import(void);
+/* The state of one parse, handed to the reentrant parser and lexer.
+ *
+ * A parse still shares process-wide state that nothing serializes: the
+ * global namespace, the constant table and the type pool, the interned
+ * strings, the parsed imports and their arena, the winrt_mode and
+ * use_abi_namespace options (which the winrt pragma sets), and the
+ * input_name the outputs are named from (which switches to the ACF).
+ * So only one parse runs in a process at a time; concurrent compiles run
+ * in separate processes, as the compile server does. */
+struct parse_context
+{
+  void *scanner;                      /* the flex scanner */
+  struct yy_buffer_state *buffer;     /* buffer being scanned */
+  char *input_data;                   /* preprocessed text being scanned */
+  char *input_name;                   /* location reported by diagnostics */
+  int line_number;
+  struct import_state import_stack[MAX_IMPORT_DEPTH];
+  int import_depth;
+  struct import_file *current_import; /* import being parsed, NULL in the input file */
+  struct imports *first_import;       /* files imported by the input so far */
+  char *cbuffer;                      /* string literal being scanned */
+  int cbufidx;
+  int cbufalloc;
+  struct namespace *current_namespace;
+  struct namespace *lookup_namespace;
+  typelib_t *current_typelib;
+  warning_list_t *disabled_warnings;  /* set with midl_pragma warning */
+  unsigned long gen_name_count;       /* names generated for anonymous types */
+  char *gen_name_id;
+  struct arena *input_arena;          /* nodes of the input file */
+  struct arena *node_arena;           /* where new nodes come from */
+  struct list input_types;            /* types allocated from input_arena */
+  struct extended_type *extended_types; /* shared types the input completed */
+};
 
-#define parse_only import_stack_ptr
+/* the parse running in this process; the type constructors, the node
+ * allocator and the diagnostics called from its actions work on it */
+extern struct parse_context *parse_ctx;
 
-int is_type(const char *name);
-int is_namespace(const char *name);
+struct parse_context *parse_context_create(void);
+void parse_context_free(struct parse_context *ctx);
+void scan_input(struct parse_context *ctx, const char *name);
+void scan_file(struct parse_context *ctx, FILE *file);
+int parser_parse(struct parse_context *ctx);
 
-int do_warning(char *toggle, warning_list_t *wnum);
-int is_warning_enabled(int warning);
+extern int parser_debug;
 
-extern char *temp_name;
+int do_import(struct parse_context *ctx, char *fname);
+void pop_import(struct parse_context *ctx);
+int import_is_visible(const struct import_file *file);
+void add_import_dependencies(void);
+
+/* types created while parsing an import are not written out */
+#define parse_only (parse_ctx && parse_ctx->current_import)
+
+int is_type(struct parse_context *ctx, const char *name);
+int is_namespace(struct parse_context *ctx, const char *name);
+void reset_types(void);
+void extend_type(type_t *type);
+void release_input_types(struct parse_context *ctx);
+void dump_symbol_stats(struct parse_context *ctx);
+
+int do_warning(struct parse_context *ctx, char *toggle, warning_list_t *wnum);
+int is_warning_enabled(int warning);
 
 #endif
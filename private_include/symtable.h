@@ -0,0 +1,48 @@
+/*
+ * Identifier hash table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_SYMTABLE_H
+#define __WIDL_SYMTABLE_H
+
+struct symbol_entry
+{
+    const char *name;
+    unsigned int hash;
+    void *data;
+};
+
+/* open addressing with linear probing, entries are never removed */
+struct symbol_table
+{
+    struct symbol_entry *entries;
+    unsigned int size;      /* power of two, or 0 before the first insertion */
+    unsigned int count;
+    unsigned long lookups;
+    unsigned long probes;
+};
+
+extern unsigned int hash_string( const char *str );
+extern char *intern_string( const char *str );
+extern void *symbol_table_find( struct symbol_table *table, const char *name );
+extern void **symbol_table_add( struct symbol_table *table, const char *name );
+extern void **symbol_table_add_copy( struct symbol_table *table, const char *name );
+extern void symbol_table_free_copies( struct symbol_table *table );
+extern void symbol_table_dump_stats( const struct symbol_table *table, const char *name );
+extern void intern_dump_stats( void );
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Per-phase timing report
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIDL_TIMING_H
+#define __WIDL_TIMING_H
+
+enum time_report_format
+{
+    TIME_REPORT_NONE,
+    TIME_REPORT_TEXT,
+    TIME_REPORT_JSON
+};
+
+extern enum time_report_format time_report;
+
+extern void time_phase_start( const char *phase, const char *file );
+extern void time_phase_end(void);
+extern unsigned int time_report_mark(void);
+extern void time_report_send( int fd, unsigned int mark );
+extern void time_report_receive( int fd );
+extern void write_time_report( const char *input );
+
+#endif
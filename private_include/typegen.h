@@ -63,8 +63,10 @@ enum typegen_type
 typedef int (*type_pred_t)(const type_t *);
 
 void write_formatstringsdecl(FILE *f, int indent, const statement_list_t *stmts, type_pred_t pred);
-void write_procformatstring(FILE *file, const statement_list_t *stmts, type_pred_t pred);
-void write_typeformatstring(FILE *file, const statement_list_t *stmts, type_pred_t pred);
+void fill_typegen_cache(const statement_list_t *stmts);
+void reset_typegen_cache(void);
+void write_procformatstring(FILE *file);
+void write_typeformatstring(FILE *file);
 void write_procformatstring_offsets( FILE *file, const type_t *iface );
 void print_phase_basetype(FILE *file, int indent, const char *local_var_prefix, enum remoting_phase phase,
                           enum pass pass, const var_t *var, const char *varname);
@@ -73,8 +75,6 @@ void write_parameter_conf_or_var_exprs(FILE *file, int indent, const char *local
 void write_remoting_arguments(FILE *file, int indent, const var_t *func, const char *local_var_prefix,
                               enum pass pass, enum remoting_phase phase);
 unsigned int get_size_procformatstring_func(const type_t *iface, const var_t *func);
-unsigned int get_size_procformatstring(const statement_list_t *stmts, type_pred_t pred);
-unsigned int get_size_typeformatstring(const statement_list_t *stmts, type_pred_t pred);
 void assign_stub_out_args( FILE *file, int indent, const var_t *func, const char *local_var_prefix );
 void declare_stub_args( FILE *file, int indent, const var_t *func );
 void write_func_param_struct( FILE *file, const type_t *iface, const type_t *func,
@@ -28,6 +28,8 @@ extern void add_importlib(const char *name);
 #else
 extern void add_importlib(const char *name, typelib_t *typelib);
 #endif
+extern importinfo_t *find_importinfo(typelib_t *typelib, const char *name);
+extern void preload_importlib(const char *name);
 
 /* Copied from wtypes.h. Not included directly because that would create a
  * circular dependency (after all, wtypes.h is generated by widl...) */
@@ -90,4 +92,5 @@ extern unsigned short get_type_vt(type_t *t);
 
 extern int create_msft_typelib(typelib_t *typelib);
 extern int create_sltg_typelib(typelib_t *typelib);
+extern void reset_sltg_index_names(void);
 #endif
@@ -36,7 +36,6 @@ int strendswith(const char* str, const char* end);
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
-void parser_error(const char *s) __attribute__((noreturn));
 int parser_warning(const char *s, ...) __attribute__((format (printf, 1, 2)));
 void error_loc(const char *s, ...) __attribute__((format (printf, 1, 2))) __attribute__((noreturn));
 void error(const char *s, ...) __attribute__((format (printf, 1, 2))) __attribute__((noreturn));
@@ -48,6 +47,7 @@ char *strmake(const char* fmt, ...) __attribute__((__format__ (__printf__, 1, 2
 
 char *dup_basename(const char *name, const char *ext);
 size_t widl_getline(char **linep, size_t *lenp, FILE *fp);
+char *read_file_data(FILE *fp, size_t *size);
 
 UUID *parse_uuid(const char *u);
 int is_valid_uuid(const char *s);
@@ -60,7 +60,10 @@ extern size_t output_buffer_pos;
 extern size_t output_buffer_size;
 
 extern void init_output_buffer(void);
+extern void reserve_output_buffer( size_t size );
 extern void flush_output_buffer( const char *name );
+extern void flush_text_output_buffer( const char *name );
+extern void remove_temp_output(void);
 extern void add_output_to_resources( const char *type, const char *name );
 extern void flush_output_resources( const char *name );
 extern void put_data( const void *data, size_t size );
@@ -72,6 +75,13 @@ extern void put_pword( unsigned int val );
 extern void put_str( int indent, const char *format, ... ) __attribute__((format (printf, 2, 3)));
 extern void align_output( unsigned int align );
 
+/* text output */
+
+extern FILE *open_output_file( const char *name );
+extern void close_output_file( FILE *file );
+extern void output_indent( FILE *file, int indent );
+extern void output_vprintf( FILE *file, const char *format, va_list args );
+
 /* typelibs expect the minor version to be stored in the higher bits and
  * major to be stored in the lower bits */
 #define MAKEVERSION(major, minor) ((((minor) & 0xffff) << 16) | ((major) & 0xffff))
@@ -45,6 +45,8 @@ extern int do_server;
 extern int do_regscript;
 extern int do_idfile;
 extern int do_dlldata;
+extern int do_depfile;
+extern int do_stats;
 extern int old_names;
 extern int win32_packing;
 extern int win64_packing;
@@ -67,12 +69,13 @@ extern char *server_name;
 extern char *server_token;
 extern char *regscript_name;
 extern char *regscript_token;
+extern char *idfile_name;
+extern char *depfile_name;
 extern const char *prefix_client;
 extern const char *prefix_server;
 extern unsigned int pointer_size;
 extern time_t now;
 
-extern int line_number;
 extern int char_number;
 
 enum target_cpu
@@ -96,12 +99,16 @@ extern void write_proxies(const statement_list_t *stmts);
 extern void write_client(const statement_list_t *stmts);
 extern void write_server(const statement_list_t *stmts);
 extern void write_regscript(const statement_list_t *stmts);
-#ifndef __REACTOS__
+#ifdef __REACTOS__
+extern void write_typelib(const statement_list_t *stmts);
+#else
 extern void write_typelib_regscript(const statement_list_t *stmts);
 #endif
 extern void output_typelib_regscript( const typelib_t *typelib );
 extern void write_local_stubs(const statement_list_t *stmts);
 extern void write_dlldata(const statement_list_t *stmts);
+extern void write_depfile(const statement_list_t *stmts);
+extern void write_outputs(const statement_list_t *stmts);
 
 extern void start_cplusplus_guard(FILE *fp);
 extern void end_cplusplus_guard(FILE *fp);
@@ -26,6 +26,7 @@
 #include "guiddef.h"
 #include "ndrtypes.h"
 #include "wine/list.h"
+#include "symtable.h"
 
 #ifndef UUID_DEFINED
 #define UUID_DEFINED
@@ -169,6 +170,8 @@ enum attr_type
     ATTR_WIREMARSHAL
 };
 
+#define ATTR_COUNT (ATTR_WIREMARSHAL + 1)
+
 enum expr_type
 {
     EXPR_VOID,
@@ -320,6 +323,20 @@ struct _attr_t {
   struct list entry;
 };
 
+/* lookup index of an attribute list, built once parsing is done */
+struct attr_index
+{
+  unsigned int mask[(ATTR_COUNT + 31) / 32];
+  const attr_t *attrs[1];  /* first attribute of each type present, in type order */
+};
+
+/* attribute lists are allocated along with room for their index */
+struct attr_list_head
+{
+  attr_list_t list;
+  struct attr_index *index;
+};
+
 struct _expr_t {
   enum expr_type type;
   const expr_t *ref;
@@ -405,14 +422,12 @@ struct alias_details
     struct _decl_spec_t aliasee;
 };
 
-#define HASHMAX 64
-
 struct namespace {
     const char *name;
     struct namespace *parent;
     struct list entry;
     struct list children;
-    struct rtype *type_hash[HASHMAX];
+    struct symbol_table types;
 };
 
 enum type_type
@@ -474,7 +489,7 @@ struct _var_t {
   unsigned int typestring_offset;
 
   /* fields specific to functions */
-  unsigned int procstring_offset, func_idx;
+  unsigned int procstring_offset, procstring_size, func_idx;
 
   struct _loc_info_t loc_info;
 
@@ -527,6 +542,7 @@ struct _importlib_t {
 
     importinfo_t *importinfos;
     int ntypeinfos;
+    struct symbol_table *index;  /* name -> importinfo, shared by all imports of the same file */
 
     int allocated;
 
@@ -537,6 +553,7 @@ struct _typelib_t {
     char *name;
     const attr_list_t *attrs;
     struct list importlibs;
+    struct symbol_table importinfos;  /* name -> importinfo across all importlibs */
     statement_list_t *stmts;
 
     type_t **reg_ifaces;
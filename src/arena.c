@@ -0,0 +1,217 @@
+/*
+ * Parse tree node allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * --------------------------------------------------------------------------------------
+ *
+ * Types, variables, expressions, attributes and the lists holding them are
+ * created by the thousand while parsing and almost never freed individually,
+ * they live until the compilation is over.  They are carved out of large
+ * chunks instead of going through malloc one by one.  The few nodes the
+ * parser drops along the way, such as declarators, go on a free list for
+ * their size and are reused by the next node of the same size.
+ *
+ * Nodes of imported files and of the input file come from separate arenas,
+ * so that batch mode can drop everything an input file added at once while
+ * keeping the imports shared with the next input.  Each parse context owns
+ * the arena of its input file and picks the arena new nodes come from.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "widl.h"
+#include "utils.h"
+#include "parser.h"
+#include "arena.h"
+
+#define NODE_ALIGN      8
+#define NB_SIZE_CLASSES 32   /* free lists for nodes up to NB_SIZE_CLASSES * NODE_ALIGN bytes */
+#define MIN_CHUNK_SIZE  (64 * 1024)
+#define MAX_CHUNK_SIZE  (4 * 1024 * 1024)
+
+struct chunk
+{
+    struct chunk *next;
+    char *end;
+};
+
+#define CHUNK_HEADER_SIZE ((sizeof(struct chunk) + NODE_ALIGN - 1) & ~(NODE_ALIGN - 1))
+
+struct arena
+{
+    struct chunk *chunks;
+    char *ptr;
+    char *end;
+    size_t chunk_size;
+    size_t used;
+    size_t reserved;
+    void *free_nodes[NB_SIZE_CLASSES];
+    struct
+    {
+        unsigned long count;
+        size_t        bytes;
+    } nodes[NB_NODE_KINDS];
+};
+
+static const char * const node_kind_names[NB_NODE_KINDS] =
+{
+    "types",
+    "type details",
+    "variables",
+    "declarators",
+    "expressions",
+    "attributes",
+    "statements",
+    "lists",
+    "other",
+};
+
+static struct arena imports;
+
+struct arena *const import_arena = &imports;
+
+/* where new nodes come from, nodes created outside of a parse are shared */
+static struct arena *current_arena( void )
+{
+    return parse_ctx ? parse_ctx->node_arena : import_arena;
+}
+
+static void add_chunk( struct arena *arena, size_t size )
+{
+    struct chunk *chunk;
+
+    /* chunks grow with the arena so that there are never many of them */
+    arena->chunk_size = arena->chunk_size ? arena->chunk_size * 2 : MIN_CHUNK_SIZE;
+    if (arena->chunk_size > MAX_CHUNK_SIZE) arena->chunk_size = MAX_CHUNK_SIZE;
+    if (size < arena->chunk_size) size = arena->chunk_size;
+
+    chunk = xmalloc( CHUNK_HEADER_SIZE + size );
+    arena->reserved += CHUNK_HEADER_SIZE + size;
+    chunk->next = arena->chunks;
+    chunk->end = (char *)chunk + CHUNK_HEADER_SIZE + size;
+    arena->chunks = chunk;
+    arena->ptr = (char *)chunk + CHUNK_HEADER_SIZE;
+    arena->end = chunk->end;
+}
+
+void *node_alloc( enum node_kind kind, size_t size )
+{
+    struct arena *arena = current_arena();
+    unsigned int class;
+    void *ret;
+
+    size = (size + NODE_ALIGN - 1) & ~(NODE_ALIGN - 1);
+    class = size / NODE_ALIGN - 1;
+    arena->nodes[kind].count++;
+    arena->nodes[kind].bytes += size;
+    if (class < NB_SIZE_CLASSES && (ret = arena->free_nodes[class]))
+    {
+        arena->free_nodes[class] = *(void **)ret;
+        return ret;
+    }
+
+    if (size > (size_t)(arena->end - arena->ptr)) add_chunk( arena, size );
+    ret = arena->ptr;
+    arena->ptr += size;
+    arena->used += size;
+    return ret;
+}
+
+/* give back a node that is no longer referenced */
+void node_free( enum node_kind kind, void *ptr, size_t size )
+{
+    struct arena *arena = current_arena();
+    unsigned int class;
+
+    if (!ptr) return;
+    size = (size + NODE_ALIGN - 1) & ~(NODE_ALIGN - 1);
+    class = size / NODE_ALIGN - 1;
+    if (class >= NB_SIZE_CLASSES) return;
+    /* a node from the other arena is left alone, it is reclaimed with its arena */
+    if (!arena_contains( arena, ptr )) return;
+    *(void **)ptr = arena->free_nodes[class];
+    arena->free_nodes[class] = ptr;
+    arena->nodes[kind].count--;
+    arena->nodes[kind].bytes -= size;
+}
+
+/* make new nodes of the current parse come from arena, returns the arena they came from */
+struct arena *set_node_arena( struct arena *arena )
+{
+    struct arena *prev;
+
+    if (!parse_ctx) return import_arena;
+    prev = parse_ctx->node_arena;
+    parse_ctx->node_arena = arena;
+    return prev;
+}
+
+struct arena *arena_create( void )
+{
+    struct arena *arena = xmalloc( sizeof(*arena) );
+
+    memset( arena, 0, sizeof(*arena) );
+    return arena;
+}
+
+int arena_contains( const struct arena *arena, const void *ptr )
+{
+    const struct chunk *chunk;
+
+    for (chunk = arena->chunks; chunk; chunk = chunk->next)
+        if ((const char *)ptr >= (const char *)chunk && (const char *)ptr < chunk->end) return 1;
+    return 0;
+}
+
+/* free all nodes of an arena at once */
+void arena_release( struct arena *arena )
+{
+    struct chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next)
+    {
+        next = chunk->next;
+        free( chunk );
+    }
+    memset( arena, 0, sizeof(*arena) );
+}
+
+void arena_free( struct arena *arena )
+{
+    arena_release( arena );
+    free( arena );
+}
+
+/* print the live nodes of each kind, the free list nodes are not counted */
+void arena_dump_stats( const struct arena *input )
+{
+    unsigned int i;
+
+    fprintf( stderr, "Parse tree nodes:\n  %-16s %8s %10s %8s %10s\n", "",
+             "imports", "bytes", "input", "bytes" );
+    for (i = 0; i < NB_NODE_KINDS; i++)
+        fprintf( stderr, "  %-16s %8lu %10lu %8lu %10lu\n", node_kind_names[i],
+                 import_arena->nodes[i].count, (unsigned long)import_arena->nodes[i].bytes,
+                 input->nodes[i].count, (unsigned long)input->nodes[i].bytes );
+    fprintf( stderr, "  %-16s %19lu %19lu\n", "arena used",
+             (unsigned long)import_arena->used, (unsigned long)input->used );
+    fprintf( stderr, "  %-16s %19lu %19lu\n", "arena reserved",
+             (unsigned long)import_arena->reserved, (unsigned long)input->reserved );
+}
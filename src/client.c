@@ -497,8 +497,7 @@ static void write_implicithandledecl(type_t *iface)
 static void init_client(void)
 {
     if (client) return;
-    if (!(client = fopen(client_name, "w")))
-        error("Could not open %s for output\n", client_name);
+    client = open_output_file(client_name);
 
     print_client("/*** Autogenerated by WIDL %s from %s - Do not edit ***/\n", PACKAGE_VERSION, input_name);
     print_client("#include <string.h>\n");
@@ -612,8 +611,8 @@ static void write_client_routines(const statement_list_t *stmts)
 
     fprintf(client, "\n");
 
-    write_procformatstring(client, stmts, need_stub);
-    write_typeformatstring(client, stmts, need_stub);
+    write_procformatstring(client);
+    write_typeformatstring(client);
 }
 
 void write_client(const statement_list_t *stmts)
@@ -628,5 +627,6 @@ void write_client(const statement_list_t *stmts)
         return;
 
     write_client_routines( stmts );
-    fclose(client);
+    close_output_file(client);
+    client = NULL;
 }
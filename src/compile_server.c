@@ -0,0 +1,352 @@
+/*
+ * Compile server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * --------------------------------------------------------------------------------------
+ *
+ * For small IDL files most of the time goes into starting widl and parsing
+ * the standard imports again.  With --server, widl parses the imports given
+ * on its command line once and then waits for compile requests on a Unix
+ * socket.  Each request is compiled in a process forked from the server, so
+ * it starts with the imports already in memory, and a failing compile that
+ * exits through error() does not take the server down.
+ *
+ * A widl started with WIDL_SERVER set in its environment acts as the client:
+ * it sends its working directory and command line to the server, along with
+ * its standard file descriptors so that diagnostics go to the right place,
+ * and exits with the status it gets back.  The outputs are written by the
+ * server process directly.  If no server is listening, or the server was
+ * started with different global options, the client compiles on its own.
+ *
+ * The socket is only accessible to the user who started the server, and
+ * both ends check that the other one runs as that same user: the server
+ * writes files on behalf of its clients and the clients hand it their
+ * file descriptors.
+ */
+
+#define _GNU_SOURCE  /* for struct ucred */
+
+#include "config.h"
+#include "wine/config.h"
+#include "wine/port.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
+# include <sys/wait.h>
+#endif
+
+#include "widl.h"
+#include "utils.h"
+#include "compile_server.h"
+
+#ifndef _WIN32
+
+struct request_header
+{
+    unsigned int size;  /* size of the working directory and arguments that follow */
+};
+
+/* far more than any command line, a larger request is not from a widl client */
+#define MAX_REQUEST_SIZE (1024 * 1024)
+
+union request_control
+{
+    struct cmsghdr hdr;
+    char buffer[CMSG_SPACE(3 * sizeof(int))];
+};
+
+static const char *socket_name;
+static pid_t server_pid;
+
+static void remove_socket(void)
+{
+    /* the forked request handlers run the atexit functions too */
+    if (getpid() == server_pid) unlink( socket_name );
+}
+
+static int init_address( struct sockaddr_un *addr, const char *name )
+{
+    if (strlen( name ) >= sizeof(addr->sun_path)) return 0;
+    memset( addr, 0, sizeof(*addr) );
+    addr->sun_family = AF_UNIX;
+    strcpy( addr->sun_path, name );
+    return 1;
+}
+
+/* check that the other end of the socket runs as the same user as we do */
+static int is_same_user( int fd )
+{
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == -1) return 0;
+    return cred.uid == getuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+    uid_t uid;
+    gid_t gid;
+
+    if (getpeereid( fd, &uid, &gid ) == -1) return 0;
+    return uid == getuid();
+#else
+    /* rely on the permissions of the socket */
+    return 1;
+#endif
+}
+
+static int write_all( int fd, const void *data, size_t size )
+{
+    const char *p = data;
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write( fd, p, size )) == -1)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static int read_all( int fd, void *data, size_t size )
+{
+    char *p = data;
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = read( fd, p, size )) <= 0)
+        {
+            if (ret == -1 && errno == EINTR) continue;
+            return 0;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+/* the header comes with the stdin, stdout and stderr of the client */
+static int receive_header( int conn, struct request_header *header, int fds[3] )
+{
+    union request_control control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+
+    iov.iov_base = header;
+    iov.iov_len = sizeof(*header);
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    if (recvmsg( conn, &msg, 0 ) != sizeof(*header)) return 0;
+    if (!(cmsg = CMSG_FIRSTHDR( &msg ))) return 0;
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return 0;
+    if (cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) return 0;
+    memcpy( fds, CMSG_DATA( cmsg ), 3 * sizeof(int) );
+    return 1;
+}
+
+static void handle_connection( int conn )
+{
+    struct request_header header;
+    char *data, *end, *p, **argv;
+    int fds[3], argc, status, i;
+    pid_t pid;
+
+    signal( SIGCHLD, SIG_DFL );
+    if (!is_same_user( conn )) return;
+    if (!receive_header( conn, &header, fds )) return;
+    if (header.size > MAX_REQUEST_SIZE) return;
+    data = xmalloc( header.size + 1 );
+    if (!read_all( conn, data, header.size )) return;
+    data[header.size] = 0;
+
+    /* working directory followed by the arguments, all null terminated */
+    end = data + header.size;
+    for (p = data, argc = -1; p < end; p += strlen( p ) + 1) argc++;
+    if (argc < 1) return;
+    argv = xmalloc( (argc + 1) * sizeof(*argv) );
+    for (p = data + strlen( data ) + 1, i = 0; i < argc; p += strlen( p ) + 1) argv[i++] = p;
+    argv[argc] = NULL;
+
+    if ((pid = fork()) == 0)
+    {
+        close( conn );
+        for (i = 0; i < 3; i++)
+        {
+            dup2( fds[i], i );
+            close( fds[i] );
+        }
+        if (chdir( data ) == -1) _exit( COMPILE_SERVER_RETRY );
+        exit( compile_request( argc, argv ));
+    }
+
+    /* anything but a normal exit is retried by the client */
+    status = -1;
+    if (pid != -1 && waitpid( pid, &status, 0 ) == pid && WIFEXITED( status ))
+        status = WEXITSTATUS( status );
+    if (status == COMPILE_SERVER_RETRY) status = -1;
+    write_all( conn, &status, sizeof(status) );
+}
+
+void run_compile_server( const char *name )
+{
+    struct sockaddr_un addr;
+    mode_t mask;
+    int fd, conn, ret;
+
+    if (!init_address( &addr, name ))
+        error( "Socket name %s is too long\n", name );
+    if ((fd = socket( AF_UNIX, SOCK_STREAM, 0 )) == -1)
+        error( "Could not create socket: %s\n", strerror( errno ));
+    unlink( name );
+    /* created with mode 0600, other users cannot connect */
+    mask = umask( 077 );
+    ret = bind( fd, (struct sockaddr *)&addr, sizeof(addr) );
+    umask( mask );
+    if (ret == -1)
+        error( "Could not bind to %s: %s\n", name, strerror( errno ));
+    socket_name = name;
+    server_pid = getpid();
+    atexit( remove_socket );
+    if (listen( fd, SOMAXCONN ) == -1)
+        error( "Could not listen on %s: %s\n", name, strerror( errno ));
+
+    /* nobody waits for the connection handlers */
+    signal( SIGCHLD, SIG_IGN );
+    chat( "Waiting for compile requests on %s\n", name );
+
+    for (;;)
+    {
+        if ((conn = accept( fd, NULL, NULL )) == -1)
+        {
+            if (errno == EINTR) continue;
+            error( "Could not accept connection: %s\n", strerror( errno ));
+        }
+        fflush( NULL );
+        switch (fork())
+        {
+        case 0:
+            close( fd );
+            handle_connection( conn );
+            _exit( 0 );
+        case -1:
+            chat( "Could not fork: %s\n", strerror( errno ));
+            /* fall through */
+        default:
+            close( conn );
+            break;
+        }
+    }
+}
+
+/* returns 0 if the request has to be compiled locally */
+int run_compile_client( const char *name, int argc, char *argv[], int *status )
+{
+    static const int fds[3] = { 0, 1, 2 };
+    union request_control control;
+    struct request_header header;
+    struct sockaddr_un addr;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char cwd[PATH_MAX], *data, *p;
+    void (*old_handler)(int);
+    int fd, i, ret = 0;
+
+    if (!init_address( &addr, name )) return 0;
+    if (!getcwd( cwd, sizeof(cwd) )) return 0;
+    if ((fd = socket( AF_UNIX, SOCK_STREAM, 0 )) == -1) return 0;
+    if (connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) == -1 || !is_same_user( fd ))
+    {
+        close( fd );
+        return 0;
+    }
+
+    header.size = strlen( cwd ) + 1;
+    for (i = 0; i < argc; i++) header.size += strlen( argv[i] ) + 1;
+    if (header.size > MAX_REQUEST_SIZE)
+    {
+        close( fd );
+        return 0;
+    }
+    p = data = xmalloc( header.size );
+    strcpy( p, cwd );
+    p += strlen( p ) + 1;
+    for (i = 0; i < argc; i++)
+    {
+        strcpy( p, argv[i] );
+        p += strlen( p ) + 1;
+    }
+
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    cmsg = CMSG_FIRSTHDR( &msg );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy( CMSG_DATA( cmsg ), fds, sizeof(fds) );
+
+    /* a server going away must not kill the client */
+    old_handler = signal( SIGPIPE, SIG_IGN );
+    if (sendmsg( fd, &msg, 0 ) == sizeof(header) &&
+        write_all( fd, data, header.size ) &&
+        read_all( fd, status, sizeof(*status) ) && *status != -1)
+        ret = 1;
+    signal( SIGPIPE, old_handler );
+
+    free( data );
+    close( fd );
+    return ret;
+}
+
+#else  /* _WIN32 */
+
+void run_compile_server( const char *name )
+{
+    error( "The compile server is not supported on this platform\n" );
+}
+
+int run_compile_client( const char *name, int argc, char *argv[], int *status )
+{
+    return 0;
+}
+
+#endif  /* _WIN32 */
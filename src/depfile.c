@@ -0,0 +1,157 @@
+/*
+ * Dependency file generation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * --------------------------------------------------------------------------------------
+ *
+ * With -MD widl writes a make rule listing every file the outputs depend
+ * on: the input and ACF files, the imported files, the files they all
+ * #include, and the typelibs read for importlib.  The preprocessed files
+ * are found through the '# <line> "<file>"' markers in the wpp output,
+ * the same way the import cache finds them.
+ */
+
+#include "config.h"
+#include "wine/config.h"
+#include "wine/port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "widl.h"
+#include "utils.h"
+#include "parser.h"
+#include "depfile.h"
+
+static char **dependencies;
+static unsigned int nb_dependencies, dependencies_size;
+
+/* call add() for the file named by each line marker in wpp output */
+void scan_line_markers( const char *data, size_t size,
+                        void (*add)( void *ctx, const char *name, size_t len ), void *ctx )
+{
+    const char *p = data, *end = data + size, *eol, *name;
+
+    for (; p < end; p = eol + 1)
+    {
+        if (!(eol = memchr( p, '\n', end - p ))) eol = end;
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        if (p == eol || *p++ != '#') continue;
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        if (p == eol || *p < '0' || *p > '9') continue;
+        if (!(p = memchr( p, '"', eol - p ))) continue;
+        name = ++p;
+        if (!(p = memchr( p, '"', eol - p ))) continue;
+        add( ctx, name, p - name );
+    }
+}
+
+static void add_dependency_len( const char *name, size_t len )
+{
+    unsigned int i;
+
+    for (i = 0; i < nb_dependencies; i++)
+        if (!strncmp( dependencies[i], name, len ) && !dependencies[i][len]) return;
+
+    if (nb_dependencies == dependencies_size)
+    {
+        dependencies_size = max( 2 * dependencies_size, 32 );
+        dependencies = xrealloc( dependencies, dependencies_size * sizeof(*dependencies) );
+    }
+    dependencies[nb_dependencies] = xmalloc( len + 1 );
+    memcpy( dependencies[nb_dependencies], name, len );
+    dependencies[nb_dependencies++][len] = 0;
+}
+
+static void add_marker_dependency( void *ctx, const char *name, size_t len )
+{
+    add_dependency_len( name, len );
+}
+
+void add_dependency( const char *name )
+{
+    if (!do_depfile) return;
+    add_dependency_len( name, strlen( name ));
+}
+
+/* add the files that went into the preprocessed text of the input or ACF file */
+void add_preprocessed_dependencies( const char *data, size_t size )
+{
+    if (!do_depfile) return;
+    scan_line_markers( data, size, add_marker_dependency, NULL );
+}
+
+/* forget the dependencies of the previous input file */
+void reset_dependencies(void)
+{
+    while (nb_dependencies) free( dependencies[--nb_dependencies] );
+}
+
+static void write_escaped( FILE *file, const char *name )
+{
+    for (; *name; name++)
+    {
+        switch (*name)
+        {
+        case ' ':
+        case '\t':
+        case '#':
+            fputc( '\\', file );
+            break;
+        case '$':
+            fputc( '$', file );
+            break;
+        }
+        fputc( *name, file );
+    }
+}
+
+static void write_target( FILE *file, int enabled, const char *name, unsigned int *count )
+{
+    if (!enabled || !name) return;
+    if ((*count)++) fputc( ' ', file );
+    write_escaped( file, name );
+}
+
+void write_depfile( const statement_list_t *stmts )
+{
+    unsigned int i, count = 0;
+    FILE *file;
+
+    if (!do_depfile) return;
+
+    add_import_dependencies();
+
+    file = open_output_file( depfile_name );
+    write_target( file, do_header, header_name, &count );
+    write_target( file, do_typelib, typelib_name, &count );
+    write_target( file, do_proxies, proxy_name, &count );
+    write_target( file, do_client, client_name, &count );
+    write_target( file, do_server, server_name, &count );
+    write_target( file, do_regscript, regscript_name, &count );
+    write_target( file, do_idfile, idfile_name, &count );
+    write_target( file, do_dlldata, dlldata_name, &count );
+    write_target( file, TRUE, local_stubs_name, &count );
+    fputc( ':', file );
+    for (i = 0; i < nb_dependencies; i++)
+    {
+        fputs( " \\\n ", file );
+        write_escaped( file, dependencies[i] );
+    }
+    fputc( '\n', file );
+    close_output_file( file );
+}
@@ -34,6 +34,7 @@
 #include "header.h"
 #include "typetree.h"
 #include "typegen.h"
+#include "arena.h"
 
 static int is_integer_type(const type_t *type)
 {
@@ -111,7 +112,7 @@ static int is_float_type(const type_t *type)
 
 expr_t *make_expr(enum expr_type type)
 {
-    expr_t *e = xmalloc(sizeof(expr_t));
+    expr_t *e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = NULL;
     e->u.lval = 0;
@@ -122,7 +123,7 @@ expr_t *make_expr(enum expr_type type)
 
 expr_t *make_exprl(enum expr_type type, int val)
 {
-    expr_t *e = xmalloc(sizeof(expr_t));
+    expr_t *e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = NULL;
     e->u.lval = val;
@@ -140,7 +141,7 @@ expr_t *make_exprl(enum expr_type type, int val)
 
 expr_t *make_exprd(enum expr_type type, double val)
 {
-    expr_t *e = xmalloc(sizeof(expr_t));
+    expr_t *e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = NULL;
     e->u.dval = val;
@@ -152,7 +153,7 @@ expr_t *make_exprd(enum expr_type type, double val)
 expr_t *make_exprs(enum expr_type type, char *val)
 {
     expr_t *e;
-    e = xmalloc(sizeof(expr_t));
+    e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = NULL;
     e->u.sval = val;
@@ -166,7 +167,6 @@ expr_t *make_exprs(enum expr_type type, char *val)
         if (c)
         {
             e->u.sval = c->name;
-            free(val);
             e->is_const = TRUE;
             e->cval = c->eval->cval;
         }
@@ -199,7 +199,7 @@ expr_t *make_exprt(enum expr_type type, var_t *var, expr_t *expr)
 
     tref = var->declspec.type;
 
-    e = xmalloc(sizeof(expr_t));
+    e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = expr;
     e->u.tref = var->declspec;
@@ -244,14 +244,14 @@ expr_t *make_exprt(enum expr_type type, var_t *var, expr_t *expr)
             e->cval = expr->cval;
         }
     }
-    free(var);
+    node_free(NODE_VAR, var, sizeof(*var));
     return e;
 }
 
 expr_t *make_expr1(enum expr_type type, expr_t *expr)
 {
     expr_t *e;
-    e = xmalloc(sizeof(expr_t));
+    e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = expr;
     e->u.lval = 0;
@@ -285,7 +285,7 @@ expr_t *make_expr1(enum expr_type type, expr_t *expr)
 expr_t *make_expr2(enum expr_type type, expr_t *expr1, expr_t *expr2)
 {
     expr_t *e;
-    e = xmalloc(sizeof(expr_t));
+    e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = expr1;
     e->u.ext = expr2;
@@ -373,7 +373,7 @@ expr_t *make_expr2(enum expr_type type, expr_t *expr1, expr_t *expr2)
 expr_t *make_expr3(enum expr_type type, expr_t *expr1, expr_t *expr2, expr_t *expr3)
 {
     expr_t *e;
-    e = xmalloc(sizeof(expr_t));
+    e = node_alloc(NODE_EXPR, sizeof(expr_t));
     e->type = type;
     e->ref = expr1;
     e->u.ext = expr2;
@@ -37,6 +37,7 @@
 #include "expr.h"
 #include "typetree.h"
 #include "typelib.h"
+#include "arena.h"
 
 static int indentation = 0;
 static int is_object_interface = 0;
@@ -48,9 +49,8 @@ static void write_type_v(FILE *f, const decl_spec_t *t, int is_field, int declon
 
 static void indent(FILE *h, int delta)
 {
-  int c;
   if (delta < 0) indentation += delta;
-  for (c=0; c<indentation; c++) fprintf(h, "    ");
+  output_indent(h, indentation);
   if (delta > 0) indentation += delta;
 }
 
@@ -59,9 +59,9 @@ static void write_line(FILE *f, int delta, const char *fmt, ...)
     va_list ap;
     indent(f, delta);
     va_start(ap, fmt);
-    vfprintf(f, fmt, ap);
+    output_vprintf(f, fmt, ap);
     va_end(ap);
-    fprintf(f, "\n");
+    fputc('\n', f);
 }
 
 int is_ptrchain_attr(const var_t *var, enum attr_type t)
@@ -97,28 +97,111 @@ int is_aliaschain_attr(const type_t *type, enum attr_type attr)
     }
 }
 
-int is_attr(const attr_list_t *list, enum attr_type t)
+/* set once the parser is done building attribute lists, lookups then go
+ * through an index instead of walking the list */
+int attr_lists_frozen;
+
+attr_list_t *new_attr_list(void)
 {
-    const attr_t *attr;
-    if (list) LIST_FOR_EACH_ENTRY( attr, list, const attr_t, entry )
-        if (attr->type == t) return 1;
-    return 0;
+    struct attr_list_head *head = node_alloc(NODE_LIST, sizeof(*head));
+
+    list_init(&head->list);
+    head->index = NULL;
+    return &head->list;
 }
 
-void *get_attrp(const attr_list_t *list, enum attr_type t)
+/* must be called whenever attributes are added to or removed from a list */
+void attr_list_changed(attr_list_t *list)
+{
+    if (list) LIST_ENTRY(list, struct attr_list_head, list)->index = NULL;
+}
+
+static inline unsigned int count_bits(unsigned int mask)
+{
+#ifdef __GNUC__
+    return __builtin_popcount(mask);
+#else
+    unsigned int count = 0;
+    for (; mask; mask &= mask - 1) count++;
+    return count;
+#endif
+}
+
+static const struct attr_index *get_attr_index(const attr_list_t *list)
+{
+    struct attr_list_head *head = LIST_ENTRY(list, struct attr_list_head, list);
+    const attr_t *first[ATTR_COUNT], *attr;
+    struct attr_index *index;
+    struct arena *arena;
+    unsigned int i, count = 0;
+
+    if (head->index || !attr_lists_frozen) return head->index;
+
+    memset(first, 0, sizeof(first));
+    LIST_FOR_EACH_ENTRY( attr, list, const attr_t, entry )
+    {
+        if (first[attr->type]) continue;
+        first[attr->type] = attr;
+        count++;
+    }
+
+    /* the index has to live exactly as long as the list */
+    if (parse_ctx && arena_contains(parse_ctx->input_arena, head))
+        arena = set_node_arena(parse_ctx->input_arena);
+    else
+        arena = set_node_arena(import_arena);
+    index = node_alloc(NODE_ATTR, sizeof(*index) + count * sizeof(index->attrs[0]));
+    set_node_arena(arena);
+
+    memset(index->mask, 0, sizeof(index->mask));
+    for (i = count = 0; i < ATTR_COUNT; i++)
+    {
+        if (!first[i]) continue;
+        index->mask[i / 32] |= 1u << (i % 32);
+        index->attrs[count++] = first[i];
+    }
+    head->index = index;
+    return index;
+}
+
+static const attr_t *find_attr(const attr_list_t *list, enum attr_type t)
 {
+    const struct attr_index *index;
     const attr_t *attr;
-    if (list) LIST_FOR_EACH_ENTRY( attr, list, const attr_t, entry )
-        if (attr->type == t) return attr->u.pval;
+    unsigned int i, pos;
+
+    if (!list) return NULL;
+    if ((index = get_attr_index(list)))
+    {
+        if (!(index->mask[t / 32] & (1u << (t % 32)))) return NULL;
+        pos = count_bits(index->mask[t / 32] & ((1u << (t % 32)) - 1));
+        for (i = 0; i < t / 32; i++) pos += count_bits(index->mask[i]);
+        return index->attrs[pos];
+    }
+    LIST_FOR_EACH_ENTRY( attr, list, const attr_t, entry )
+        if (attr->type == t) return attr;
     return NULL;
 }
 
+int is_attr(const attr_list_t *list, enum attr_type t)
+{
+    const struct attr_index *index;
+
+    if (list && (index = get_attr_index(list)))
+        return (index->mask[t / 32] >> (t % 32)) & 1;
+    return find_attr(list, t) != NULL;
+}
+
+void *get_attrp(const attr_list_t *list, enum attr_type t)
+{
+    const attr_t *attr = find_attr(list, t);
+    return attr ? attr->u.pval : NULL;
+}
+
 unsigned int get_attrv(const attr_list_t *list, enum attr_type t)
 {
-    const attr_t *attr;
-    if (list) LIST_FOR_EACH_ENTRY( attr, list, const attr_t, entry )
-        if (attr->type == t) return attr->u.ival;
-    return 0;
+    const attr_t *attr = find_attr(list, t);
+    return attr ? attr->u.ival : 0;
 }
 
 static void write_guid(FILE *f, const char *guid_prefix, const char *name, const UUID *uuid)
@@ -1223,7 +1306,7 @@ static void write_inline_wrappers(FILE *header, const type_t *iface, const type_
 #else
       fprintf(header, "static FORCEINLINE ");
 #endif
-      write_type_decl_left(header, type_function_get_rettype(func->type));
+      write_type_decl_left(header, type_function_get_ret(func->declspec.type));
       fprintf(header, " %s_%s(", name, get_name(func));
       write_args(header, type_function_get_args(func->declspec.type), name, 1, FALSE, NAME_C);
       fprintf(header, ") {\n");
@@ -1419,18 +1502,14 @@ void write_local_stubs(const statement_list_t *stmts)
 
   if (!local_stubs_name) return;
 
-  local_stubs = fopen(local_stubs_name, "w");
-  if (!local_stubs) {
-    error("Could not open %s for output\n", local_stubs_name);
-    return;
-  }
+  local_stubs = open_output_file(local_stubs_name);
   fprintf(local_stubs, "/* call_as/local stubs for %s */\n\n", input_name);
   fprintf(local_stubs, "#include <objbase.h>\n");
   fprintf(local_stubs, "#include \"%s\"\n\n", header_name);
 
   write_local_stubs_stmts(local_stubs, stmts);
 
-  fclose(local_stubs);
+  close_output_file(local_stubs);
 }
 
 static void write_function_proto(FILE *header, const type_t *iface, const var_t *fun, const char *prefix)
@@ -1809,10 +1888,7 @@ void write_header(const statement_list_t *stmts)
 
   if (!do_header) return;
 
-  if(!(header = fopen(header_name, "w"))) {
-    error("Could not open %s for output\n", header_name);
-    return;
-  }
+  header = open_output_file(header_name);
   fprintf(header, "/*** Autogenerated by WIDL %s from %s - Do not edit ***/\n\n", PACKAGE_VERSION, input_name);
 
   fprintf(header, "#ifdef _WIN32\n");
@@ -1861,5 +1937,5 @@ void write_header(const statement_list_t *stmts)
   end_cplusplus_guard(header);
   fprintf(header, "#endif /* __%s__ */\n", header_token);
 
-  fclose(header);
+  close_output_file(header);
 }
@@ -0,0 +1,307 @@
+/*
+ * Preprocessed import cache
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * --------------------------------------------------------------------------------------
+ *
+ * Every imported file is run through wpp before the parser sees it.  The
+ * preprocessed text only depends on the file contents, the files it
+ * #includes and the command line defines and include paths, so it is
+ * cached on disk and reused by later widl runs.
+ *
+ * The parsed result of an import is not cached on disk.  The lexer
+ * classifies identifiers against the types registered so far, so such an
+ * entry would have to be keyed by the whole import closure, and widl has
+ * no serialized form of its parse tree: types, attributes, expressions,
+ * statement lists and namespaces all point to each other, and parsing an
+ * import also registers its names.  Parsed imports are instead shared in
+ * memory by the inputs of a --batch run and the requests of a compile
+ * server, which gives the one parse per build this cache cannot.
+ *
+ * A cache entry is named after a hash of the import path, its contents and
+ * the preprocessor options.  It starts with a list of all files that went
+ * into it (taken from the line markers in wpp output) along with a hash of
+ * their contents, and the entry is only used if all of them still match.
+ *
+ * The directory also keeps data that other parts of widl derive from a
+ * file, such as the typeinfo names of an importlib.  Such an entry is named
+ * after a key string given by the caller, which identifies the file, and
+ * starts with that key so that a hash collision is never taken for a hit.
+ */
+
+#include "config.h"
+#include "wine/config.h"
+#include "wine/port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "widl.h"
+#include "utils.h"
+#include "importcache.h"
+#include "depfile.h"
+
+#define CACHE_MAGIC "WIDL-IMPORT-CACHE 1\n"
+#define DATA_MAGIC "WIDL-DATA-CACHE 1\n"
+
+char *import_cache_dir;
+
+static unsigned long long key_hash = 14695981039346656037ull;
+
+struct dependency
+{
+    char *name;
+    struct list entry;
+};
+
+static unsigned long long hash_data( unsigned long long hash, const void *data, size_t size )
+{
+    const unsigned char *p = data;
+
+    /* 64-bit FNV-1a */
+    while (size--)
+    {
+        hash ^= *p++;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int hash_file( const char *name, unsigned long long *ret )
+{
+    unsigned long long hash = 14695981039346656037ull;
+    char buffer[8192];
+    size_t size;
+    FILE *f;
+
+    if (!(f = fopen( name, "rb" ))) return 0;
+    while ((size = fread( buffer, 1, sizeof(buffer), f )))
+        hash = hash_data( hash, buffer, size );
+    if (ferror( f ))
+    {
+        fclose( f );
+        return 0;
+    }
+    fclose( f );
+    *ret = hash;
+    return 1;
+}
+
+/* mix an option that influences preprocessor output into the cache key */
+void import_cache_add_key( const char *fmt, ... )
+{
+    char *str;
+    va_list ap;
+    int n;
+
+    va_start( ap, fmt );
+    n = vsnprintf( NULL, 0, fmt, ap );
+    va_end( ap );
+    str = xmalloc( n + 1 );
+    va_start( ap, fmt );
+    vsnprintf( str, n + 1, fmt, ap );
+    va_end( ap );
+
+    key_hash = hash_data( key_hash, str, n + 1 );
+    free( str );
+}
+
+static char *get_cache_name( const char *path )
+{
+    unsigned long long hash = key_hash, content;
+
+    if (!hash_file( path, &content )) return NULL;
+    hash = hash_data( hash, PACKAGE_VERSION, sizeof(PACKAGE_VERSION) );
+    hash = hash_data( hash, path, strlen( path ) + 1 );
+    hash = hash_data( hash, &content, sizeof(content) );
+    return strmake( "%s/%016llx.i", import_cache_dir, hash );
+}
+
+/* load the preprocessed text of an import from the cache */
+char *import_cache_load( const char *path, size_t *size )
+{
+    char *name, *line = NULL, *data;
+    size_t len = 0, n;
+    FILE *f;
+
+    if (!import_cache_dir) return NULL;
+    if (!(name = get_cache_name( path ))) return NULL;
+    f = fopen( name, "r" );
+    free( name );
+    if (!f) return NULL;
+
+    n = widl_getline( &line, &len, f );
+    if (n != strlen( CACHE_MAGIC ) || strcmp( line, CACHE_MAGIC )) goto miss;
+
+    while ((n = widl_getline( &line, &len, f )))
+    {
+        unsigned long long stored, current;
+        char *dep;
+
+        if (line[n - 1] != '\n') goto miss;
+        line[--n] = 0;
+        if (!strcmp( line, "." ))
+        {
+            free( line );
+            data = read_file_data( f, size );
+            fclose( f );
+            if (data) chat( "Using cached preprocessed import %s\n", path );
+            return data;
+        }
+        stored = strtoull( line, &dep, 16 );
+        if (*dep++ != ' ') goto miss;
+        if (!hash_file( dep, &current ) || current != stored) goto miss;
+    }
+
+miss:
+    free( line );
+    fclose( f );
+    return NULL;
+}
+
+static void add_cache_dependency( void *ctx, const char *name, size_t len )
+{
+    struct list *deps = ctx;
+    struct dependency *dep;
+
+    LIST_FOR_EACH_ENTRY( dep, deps, struct dependency, entry )
+        if (strlen( dep->name ) == len && !memcmp( dep->name, name, len )) return;
+
+    dep = xmalloc( sizeof(*dep) );
+    dep->name = xmalloc( len + 1 );
+    memcpy( dep->name, name, len );
+    dep->name[len] = 0;
+    list_add_tail( deps, &dep->entry );
+}
+
+/* store the preprocessed output of an import in the cache */
+void import_cache_store( const char *path, const char *data, size_t size )
+{
+    struct list deps = LIST_INIT( deps );
+    struct dependency *dep, *next;
+    char *name, *temp = NULL;
+    FILE *out = NULL;
+    int fd, ok = 0;
+
+    if (!import_cache_dir) return;
+    if (!(name = get_cache_name( path ))) return;
+
+    add_cache_dependency( &deps, path, strlen( path ) );
+    scan_line_markers( data, size, add_cache_dependency, &deps );
+
+    temp = strmake( "%s.XXXXXX", name );
+    if ((fd = mkstemps( temp, 0 )) == -1) goto done;
+    if (!(out = fdopen( fd, "w" )))
+    {
+        close( fd );
+        goto done;
+    }
+
+    fputs( CACHE_MAGIC, out );
+    LIST_FOR_EACH_ENTRY( dep, &deps, struct dependency, entry )
+    {
+        unsigned long long hash;
+        if (!hash_file( dep->name, &hash )) goto done;
+        fprintf( out, "%016llx %s\n", hash, dep->name );
+    }
+    fputs( ".\n", out );
+
+    ok = fwrite( data, 1, size, out ) == size;
+
+done:
+    if (out && fclose( out )) ok = 0;
+    if (temp)
+    {
+        /* rename is atomic, concurrent widl processes never see partial entries */
+        if (ok && !rename( temp, name ))
+            chat( "Cached preprocessed import %s\n", path );
+        else
+            unlink( temp );
+        free( temp );
+    }
+    LIST_FOR_EACH_ENTRY_SAFE( dep, next, &deps, struct dependency, entry )
+    {
+        list_remove( &dep->entry );
+        free( dep->name );
+        free( dep );
+    }
+    free( name );
+}
+
+static char *get_data_cache_name( const char *key )
+{
+    unsigned long long hash = 14695981039346656037ull;
+
+    hash = hash_data( hash, PACKAGE_VERSION, sizeof(PACKAGE_VERSION) );
+    hash = hash_data( hash, key, strlen( key ) + 1 );
+    return strmake( "%s/%016llx.d", import_cache_dir, hash );
+}
+
+/* load the data stored under key, which must not contain a newline */
+void *import_cache_load_data( const char *key, size_t *size )
+{
+    char *name, *line = NULL, *data = NULL;
+    size_t len = 0, n;
+    FILE *f;
+
+    if (!import_cache_dir) return NULL;
+    name = get_data_cache_name( key );
+    f = fopen( name, "rb" );
+    free( name );
+    if (!f) return NULL;
+
+    n = widl_getline( &line, &len, f );
+    if (n != strlen( DATA_MAGIC ) || strcmp( line, DATA_MAGIC )) goto done;
+    n = widl_getline( &line, &len, f );
+    if (n != strlen( key ) + 1 || strncmp( line, key, n - 1 ) || line[n - 1] != '\n') goto done;
+    data = read_file_data( f, size );
+
+done:
+    free( line );
+    fclose( f );
+    return data;
+}
+
+/* store data under key, for later runs to load with import_cache_load_data */
+void import_cache_store_data( const char *key, const void *data, size_t size )
+{
+    char *name, *temp;
+    FILE *out = NULL;
+    int fd, ok = 0;
+
+    if (!import_cache_dir) return;
+    name = get_data_cache_name( key );
+    temp = strmake( "%s.XXXXXX", name );
+    if ((fd = mkstemps( temp, 0 )) != -1)
+    {
+        if ((out = fdopen( fd, "wb" )))
+        {
+            fprintf( out, "%s%s\n", DATA_MAGIC, key );
+            ok = fwrite( data, 1, size, out ) == size;
+            if (fclose( out )) ok = 0;
+        }
+        else close( fd );
+        /* rename is atomic, concurrent widl processes never see partial entries */
+        if (!ok || rename( temp, name )) unlink( temp );
+    }
+    free( temp );
+    free( name );
+}
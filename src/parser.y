@@ -37,6 +37,8 @@
 #include "typegen.h"
 #include "expr.h"
 #include "typetree.h"
+#include "arena.h"
+#include "timing.h"
 
 typedef struct list typelist_t;
 struct typenode {
@@ -73,16 +75,15 @@ static void append_chain_type(declarator_t *decl, type_t *type, enum type_qualif
 static void append_chain_callconv(type_t *chain, char *callconv);
 static warning_list_t *append_warning(warning_list_t *, int);
 
-static type_t *reg_typedefs(decl_spec_t *decl_spec, var_list_t *names, attr_list_t *attrs);
-static type_t *find_type_or_error(const char *name, int t);
-static type_t *find_type_or_error2(char *name, int t);
+static type_t *reg_typedefs(struct parse_context *ctx, decl_spec_t *decl_spec, var_list_t *names, attr_list_t *attrs);
+static type_t *find_type_or_error(struct parse_context *ctx, const char *name, int t);
 
 static var_t *reg_const(var_t *var);
 
-static void push_namespace(const char *name);
-static void pop_namespace(const char *name);
-static void init_lookup_namespace(const char *name);
-static void push_lookup_namespace(const char *name);
+static void push_namespace(struct parse_context *ctx, const char *name);
+static void pop_namespace(struct parse_context *ctx, const char *name);
+static void init_lookup_namespace(struct parse_context *ctx, const char *name);
+static void push_lookup_namespace(struct parse_context *ctx, const char *name);
 
 static void check_arg_attrs(const var_t *arg);
 static void check_statements(const statement_list_t *stmts, int is_inside_library);
@@ -114,24 +115,34 @@ static statement_t *make_statement_pragma(const char *str);
 static statement_t *make_statement_cppquote(const char *str);
 static statement_t *make_statement_importlib(const char *str);
 static statement_t *make_statement_module(type_t *type);
-static statement_t *make_statement_typedef(var_list_t *names, int declonly);
+static statement_t *make_statement_typedef(struct parse_context *ctx, var_list_t *names, int declonly);
 static statement_t *make_statement_import(const char *str);
 static statement_list_t *append_statement(statement_list_t *list, statement_t *stmt);
 static statement_list_t *append_statements(statement_list_t *, statement_list_t *);
 static attr_list_t *append_attribs(attr_list_t *, attr_list_t *);
+static void parser_error(struct parse_context *ctx, const char *message);
 
 static struct namespace global_namespace = {
     NULL, NULL, LIST_INIT(global_namespace.entry), LIST_INIT(global_namespace.children)
 };
 
-static struct namespace *current_namespace = &global_namespace;
-static struct namespace *lookup_namespace = &global_namespace;
+%}
 
-#ifndef __REACTOS__
-static typelib_t *current_typelib;
-#endif
+%code requires
+{
+struct parse_context;
+}
+
+%code provides
+{
+int parser_lex(YYSTYPE *lval, struct parse_context *ctx);
+void reset_namespaces(struct parse_context *ctx);
+}
+
+%define api.pure full
+%parse-param {struct parse_context *ctx}
+%lex-param {struct parse_context *ctx}
 
-%}
 %union {
 	attr_t *attr;
 	attr_list_t *attr_list;
@@ -318,34 +329,29 @@ static typelib_t *current_typelib;
 
 %%
 
-input: gbl_statements m_acf			{ check_statements($1, FALSE);
+input: gbl_statements m_acf			{ attr_lists_frozen = TRUE;
+						  time_phase_start("check", NULL);
+						  check_statements($1, FALSE);
 						  check_all_user_types($1);
-						  write_header($1);
-						  write_id_data($1);
-						  write_proxies($1);
-						  write_client($1);
-						  write_server($1);
-						  write_regscript($1);
-#ifndef __REACTOS__
-						  write_typelib_regscript($1);
-#endif
-						  write_dlldata($1);
-						  write_local_stubs($1);
+						  time_phase_end();
+						  /* the parse is over, nodes made while writing are shared */
+						  ctx->node_arena = import_arena;
+						  write_outputs($1);
 						}
 	;
 
 m_acf: /* empty */ | aACF acf_statements
 
 gbl_statements:					{ $$ = NULL; }
-	| gbl_statements namespacedef '{' { push_namespace($2); } gbl_statements '}'
-						{ pop_namespace($2); $$ = append_statements($1, $5); }
+	| gbl_statements namespacedef '{' { push_namespace(ctx, $2); } gbl_statements '}'
+						{ pop_namespace(ctx, $2); $$ = append_statements($1, $5); }
 	| gbl_statements interfacedec		{ $$ = append_statement($1, make_statement_reference($2)); }
 	| gbl_statements interfacedef		{ $$ = append_statement($1, make_statement_type_decl($2)); }
 	| gbl_statements coclass ';'		{ $$ = $1;
-						  reg_type($2, $2->name, current_namespace, 0);
+						  reg_type($2, $2->name, ctx->current_namespace, 0);
 						}
 	| gbl_statements coclassdef		{ $$ = append_statement($1, make_statement_type_decl($2));
-						  reg_type($2, $2->name, current_namespace, 0);
+						  reg_type($2, $2->name, ctx->current_namespace, 0);
 						}
 	| gbl_statements moduledef		{ $$ = append_statement($1, make_statement_module($2)); }
 	| gbl_statements librarydef		{ $$ = append_statement($1, make_statement_library($2)); }
@@ -354,12 +360,12 @@ gbl_statements:					{ $$ = NULL; }
 
 imp_statements:					{ $$ = NULL; }
 	| imp_statements interfacedec		{ $$ = append_statement($1, make_statement_reference($2)); }
-	| imp_statements namespacedef '{' { push_namespace($2); } imp_statements '}'
-						{ pop_namespace($2); $$ = append_statements($1, $5); }
+	| imp_statements namespacedef '{' { push_namespace(ctx, $2); } imp_statements '}'
+						{ pop_namespace(ctx, $2); $$ = append_statements($1, $5); }
 	| imp_statements interfacedef		{ $$ = append_statement($1, make_statement_type_decl($2)); }
-	| imp_statements coclass ';'		{ $$ = $1; reg_type($2, $2->name, current_namespace, 0); }
+	| imp_statements coclass ';'		{ $$ = $1; reg_type($2, $2->name, ctx->current_namespace, 0); }
 	| imp_statements coclassdef		{ $$ = append_statement($1, make_statement_type_decl($2));
-						  reg_type($2, $2->name, current_namespace, 0);
+						  reg_type($2, $2->name, ctx->current_namespace, 0);
 						}
 	| imp_statements moduledef		{ $$ = append_statement($1, make_statement_module($2)); }
 	| imp_statements statement		{ $$ = append_statement($1, $2); }
@@ -389,7 +395,7 @@ pragma_warning: tPRAGMA_WARNING '(' aIDENTIFIER ':' warnings ')'
                   {
                       int result;
                       $$ = NULL;
-                      result = do_warning($3, $5);
+                      result = do_warning(ctx, $3, $5);
                       if(!result)
                           error_loc("expected \"disable\" or \"enable\"\n");
                   }
@@ -402,9 +408,9 @@ warnings:
 
 typedecl:
 	  enumdef
-	| tENUM aIDENTIFIER                     { $$ = type_new_enum($2, current_namespace, FALSE, NULL); }
+	| tENUM aIDENTIFIER                     { $$ = type_new_enum($2, ctx->current_namespace, FALSE, NULL); }
 	| structdef
-	| tSTRUCT aIDENTIFIER                   { $$ = type_new_struct($2, current_namespace, FALSE, NULL); }
+	| tSTRUCT aIDENTIFIER                   { $$ = type_new_struct($2, ctx->current_namespace, FALSE, NULL); }
 	| uniondef
 	| tUNION aIDENTIFIER                    { $$ = type_new_nonencapsulated_union($2, FALSE, NULL); }
 	| attributes enumdef                    { $$ = $2; $$->attrs = check_enum_attrs($1); }
@@ -415,16 +421,16 @@ typedecl:
 cppquote: tCPPQUOTE '(' aSTRING ')'		{ $$ = $3; }
 	;
 import_start: tIMPORT aSTRING ';'		{ assert(yychar == YYEMPTY);
-						  $$ = xmalloc(sizeof(struct _import_t));
+						  $$ = node_alloc(NODE_OTHER, sizeof(struct _import_t));
 						  $$->name = $2;
-						  $$->import_performed = do_import($2);
+						  $$->import_performed = do_import(ctx, $2);
 						  if (!$$->import_performed) yychar = aEOF;
 						}
 	;
 
 import: import_start imp_statements aEOF	{ $$ = $1->name;
-						  if ($1->import_performed) pop_import();
-						  free($1);
+						  if ($1->import_performed) pop_import(ctx);
+						  node_free(NODE_OTHER, $1, sizeof(*$1));
 						}
 	;
 
@@ -432,7 +438,7 @@ importlib: tIMPORTLIB '(' aSTRING ')'
 /* ifdef __REACTOS__ */
 	   semicolon_opt			{ $$ = $3; if(!parse_only) add_importlib($3); }
 /* else
-	   semicolon_opt			{ $$ = $3; if(!parse_only) add_importlib($3, current_typelib); }
+	   semicolon_opt			{ $$ = $3; if(!parse_only) add_importlib($3, ctx->current_typelib); }
 */
 	;
 
@@ -443,7 +449,7 @@ library_start: attributes libraryhdr '{'	{ $$ = make_library($2, check_library_a
 /* ifdef __REACTOS__ */
 						  if (!parse_only) start_typelib($$);
 /* else
-						  if (!parse_only && do_typelib) current_typelib = $$;
+						  if (!parse_only && do_typelib) ctx->current_typelib = $$;
 */
 						}
 	;
@@ -467,19 +473,19 @@ arg_list: arg					{ check_arg_attrs($1); $$ = append_var( NULL, $1 ); }
 	;
 
 args:	  arg_list
-	| arg_list ',' ELLIPSIS			{ $$ = append_var( $1, make_var(strdup("...")) ); }
+	| arg_list ',' ELLIPSIS			{ $$ = append_var( $1, make_var(intern_string("...")) ); }
 	;
 
 /* split into two rules to get bison to resolve a tVOID conflict */
 arg:	  attributes decl_spec m_any_declarator	{ if ($2->stgclass != STG_NONE && $2->stgclass != STG_REGISTER)
 						    error_loc("invalid storage class for function parameter\n");
 						  $$ = declare_var($1, $2, $3, TRUE);
-						  free($2); free($3);
+						  node_free(NODE_DECLARATOR, $2, sizeof(*$2)); node_free(NODE_DECLARATOR, $3, sizeof(*$3));
 						}
 	| decl_spec m_any_declarator		{ if ($1->stgclass != STG_NONE && $1->stgclass != STG_REGISTER)
 						    error_loc("invalid storage class for function parameter\n");
 						  $$ = declare_var(NULL, $1, $2, TRUE);
-						  free($1); free($2);
+						  node_free(NODE_DECLARATOR, $1, sizeof(*$1)); node_free(NODE_DECLARATOR, $2, sizeof(*$2));
 						}
 	;
 
@@ -675,7 +681,7 @@ enum:	  enum_member '=' expr_int_const	{ $$ = reg_const($1);
 						}
 	;
 
-enumdef: tENUM t_ident '{' enums '}'		{ $$ = type_new_enum($2, current_namespace, TRUE, $4); }
+enumdef: tENUM t_ident '{' enums '}'		{ $$ = type_new_enum($2, ctx->current_namespace, TRUE, $4); }
 	;
 
 m_exprs:  m_expr                                { $$ = append_expr( NULL, $1 ); }
@@ -724,9 +730,9 @@ expr:	  aNUM					{ $$ = make_exprl(EXPR_NUM, $1); }
 	| expr MEMBERPTR aIDENTIFIER		{ $$ = make_expr2(EXPR_MEMBER, make_expr1(EXPR_PPTR, $1), make_exprs(EXPR_IDENTIFIER, $3)); }
 	| expr '.' aIDENTIFIER			{ $$ = make_expr2(EXPR_MEMBER, $1, make_exprs(EXPR_IDENTIFIER, $3)); }
 	| '(' decl_spec m_abstract_declarator ')' expr %prec CAST
-						{ $$ = make_exprt(EXPR_CAST, declare_var(NULL, $2, $3, 0), $5); free($2); free($3); }
+						{ $$ = make_exprt(EXPR_CAST, declare_var(NULL, $2, $3, 0), $5); node_free(NODE_DECLARATOR, $2, sizeof(*$2)); node_free(NODE_DECLARATOR, $3, sizeof(*$3)); }
 	| tSIZEOF '(' decl_spec m_abstract_declarator ')'
-						{ $$ = make_exprt(EXPR_SIZEOF, declare_var(NULL, $3, $4, 0), NULL); free($3); free($4); }
+						{ $$ = make_exprt(EXPR_SIZEOF, declare_var(NULL, $3, $4, 0), NULL); node_free(NODE_DECLARATOR, $3, sizeof(*$3)); node_free(NODE_DECLARATOR, $4, sizeof(*$4)); }
 	| expr '[' expr ']'			{ $$ = make_expr2(EXPR_ARRAY, $1, $3); }
 	| '(' expr ')'				{ $$ = $2; }
 	;
@@ -778,7 +784,7 @@ union_field:
 
 s_field:  m_attributes decl_spec declarator	{ $$ = declare_var(check_field_attrs($3->var->name, $1),
 						                $2, $3, FALSE);
-						  free($3);
+						  node_free(NODE_DECLARATOR, $3, sizeof(*$3));
 						}
 	| m_attributes structdef		{ var_t *v = make_var(NULL);
 						  v->declspec.type = $2; v->attrs = $1;
@@ -796,10 +802,10 @@ funcdef: declaration				{ $$ = $1;
 declaration:
 	  attributes decl_spec init_declarator
 						{ $$ = declare_var($1, $2, $3, FALSE);
-						  free($3);
+						  node_free(NODE_DECLARATOR, $3, sizeof(*$3));
 						}
 	| decl_spec init_declarator		{ $$ = declare_var(NULL, $1, $2, FALSE);
-						  free($2);
+						  node_free(NODE_DECLARATOR, $2, sizeof(*$2));
 						}
 	;
 
@@ -817,17 +823,17 @@ ident:	  aIDENTIFIER				{ $$ = make_var($1); }
 	| aKNOWNTYPE				{ $$ = make_var($<str>1); }
 	;
 
-base_type: tBYTE				{ $$ = find_type_or_error($<str>1, 0); }
-	| tWCHAR				{ $$ = find_type_or_error($<str>1, 0); }
+base_type: tBYTE				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
+	| tWCHAR				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
 	| int_std
 	| tSIGNED int_std			{ $$ = type_new_int(type_basic_get_type($2), -1); }
 	| tUNSIGNED int_std			{ $$ = type_new_int(type_basic_get_type($2), 1); }
 	| tUNSIGNED				{ $$ = type_new_int(TYPE_BASIC_INT, 1); }
-	| tFLOAT				{ $$ = find_type_or_error($<str>1, 0); }
-	| tDOUBLE				{ $$ = find_type_or_error($<str>1, 0); }
-	| tBOOLEAN				{ $$ = find_type_or_error($<str>1, 0); }
-	| tERRORSTATUST				{ $$ = find_type_or_error($<str>1, 0); }
-	| tHANDLET				{ $$ = find_type_or_error($<str>1, 0); }
+	| tFLOAT				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
+	| tDOUBLE				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
+	| tBOOLEAN				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
+	| tERRORSTATUST				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
+	| tHANDLET				{ $$ = find_type_or_error(ctx, $<str>1, 0); }
 	;
 
 m_int:
@@ -846,13 +852,13 @@ int_std:  tINT					{ $$ = type_new_int(TYPE_BASIC_INT, 0); }
 	;
 
 qualified_seq:
-      aKNOWNTYPE      { $$ = find_type_or_error($1, 0); }
-    | aIDENTIFIER '.' { push_lookup_namespace($1); } qualified_seq { $$ = $4; }
+      aKNOWNTYPE      { $$ = find_type_or_error(ctx, $1, 0); }
+    | aIDENTIFIER '.' { push_lookup_namespace(ctx, $1); } qualified_seq { $$ = $4; }
     ;
 
 qualified_type:
-      aKNOWNTYPE     { $$ = find_type_or_error($1, 0); }
-    | aNAMESPACE '.' { init_lookup_namespace($1); } qualified_seq { $$ = $4; }
+      aKNOWNTYPE     { $$ = find_type_or_error(ctx, $1, 0); }
+    | aNAMESPACE '.' { init_lookup_namespace(ctx, $1); } qualified_seq { $$ = $4; }
     ;
 
 coclass:  tCOCLASS aIDENTIFIER			{ $$ = type_new_coclass($2); }
@@ -866,6 +872,7 @@ coclass:  tCOCLASS aIDENTIFIER			{ $$ = type_new_coclass($2); }
 
 coclasshdr: attributes coclass			{ $$ = $2;
 						  check_def($$);
+						  extend_type($$);
 						  $$->attrs = check_coclass_attrs($2->name, $1);
 						}
 	;
@@ -886,13 +893,14 @@ coclass_int:
 	  m_attributes interfacedec		{ $$ = make_ifref($2); $$->attrs = $1; }
 	;
 
-dispinterface: tDISPINTERFACE aIDENTIFIER	{ $$ = get_type(TYPE_INTERFACE, $2, current_namespace, 0); }
-	|      tDISPINTERFACE aKNOWNTYPE	{ $$ = get_type(TYPE_INTERFACE, $2, current_namespace, 0); }
+dispinterface: tDISPINTERFACE aIDENTIFIER	{ $$ = get_type(TYPE_INTERFACE, $2, ctx->current_namespace, 0); }
+	|      tDISPINTERFACE aKNOWNTYPE	{ $$ = get_type(TYPE_INTERFACE, $2, ctx->current_namespace, 0); }
 	;
 
 dispinterfacehdr: attributes dispinterface	{ attr_t *attrs;
 						  $$ = $2;
 						  check_def($$);
+						  extend_type($$);
 						  attrs = make_attr(ATTR_DISPINTERFACE);
 						  $$->attrs = append_attr( check_dispiface_attrs($2->name, $1), attrs );
 						  $$->defined = TRUE;
@@ -923,12 +931,13 @@ inherit:					{ $$ = NULL; }
 	| ':' qualified_type                    { $$ = $2; }
 	;
 
-interface: tINTERFACE aIDENTIFIER		{ $$ = get_type(TYPE_INTERFACE, $2, current_namespace, 0); }
-	|  tINTERFACE aKNOWNTYPE		{ $$ = get_type(TYPE_INTERFACE, $2, current_namespace, 0); }
+interface: tINTERFACE aIDENTIFIER		{ $$ = get_type(TYPE_INTERFACE, $2, ctx->current_namespace, 0); }
+	|  tINTERFACE aKNOWNTYPE		{ $$ = get_type(TYPE_INTERFACE, $2, ctx->current_namespace, 0); }
 	;
 
 interfacehdr: attributes interface		{ $$ = $2;
 						  check_def($2);
+						  extend_type($2);
 						  $2->attrs = check_iface_attrs($2->name, $1);
 						  $2->defined = TRUE;
 						}
@@ -946,7 +955,7 @@ interfacedef: interfacehdr inherit
 	| interfacehdr ':' aIDENTIFIER
 	  '{' import int_statements '}'
 	   semicolon_opt			{ $$ = $1;
-						  type_interface_define($$, find_type_or_error2($3, 0), $6);
+						  type_interface_define($$, find_type_or_error(ctx, $3, 0), $6);
 						}
 	| dispinterfacedef semicolon_opt	{ $$ = $1; }
 	;
@@ -961,6 +970,7 @@ module:   tMODULE aIDENTIFIER			{ $$ = type_new_module($2); }
 	;
 
 modulehdr: attributes module			{ $$ = $2;
+						  extend_type($$);
 						  $$->attrs = check_module_attrs($2->name, $1);
 						}
 	;
@@ -1131,16 +1141,16 @@ pointer_type:
 	| tPTR					{ $$ = FC_FP; }
 	;
 
-structdef: tSTRUCT t_ident '{' fields '}'	{ $$ = type_new_struct($2, current_namespace, TRUE, $4); }
+structdef: tSTRUCT t_ident '{' fields '}'	{ $$ = type_new_struct($2, ctx->current_namespace, TRUE, $4); }
 	;
 
 type:	  tVOID					{ $$ = type_new_void(); }
 	| qualified_type                        { $$ = $1; }
 	| base_type				{ $$ = $1; }
 	| enumdef				{ $$ = $1; }
-	| tENUM aIDENTIFIER			{ $$ = type_new_enum($2, current_namespace, FALSE, NULL); }
+	| tENUM aIDENTIFIER			{ $$ = type_new_enum($2, ctx->current_namespace, FALSE, NULL); }
 	| structdef				{ $$ = $1; }
-	| tSTRUCT aIDENTIFIER			{ $$ = type_new_struct($2, current_namespace, FALSE, NULL); }
+	| tSTRUCT aIDENTIFIER			{ $$ = type_new_struct($2, ctx->current_namespace, FALSE, NULL); }
 	| uniondef				{ $$ = $1; }
 	| tUNION aIDENTIFIER			{ $$ = type_new_nonencapsulated_union($2, FALSE, NULL); }
 	| tSAFEARRAY '(' type ')'		{ $$ = make_safearray($3); }
@@ -1148,8 +1158,8 @@ type:	  tVOID					{ $$ = type_new_void(); }
 
 typedef: m_attributes tTYPEDEF m_attributes decl_spec declarator_list
 						{ $1 = append_attribs($1, $3);
-						  reg_typedefs($4, $5, check_typedef_attrs($1));
-						  $$ = make_statement_typedef($5, !$4->type->defined);
+						  reg_typedefs(ctx, $4, $5, check_typedef_attrs($1));
+						  $$ = make_statement_typedef(ctx, $5, !$4->type->defined);
 						}
 	;
 
@@ -1176,14 +1186,16 @@ acf_int_statements
 
 acf_int_statement
         : tTYPEDEF acf_attributes aKNOWNTYPE ';'
-                                                { type_t *type = find_type_or_error($3, 0);
+                                                { type_t *type = find_type_or_error(ctx, $3, 0);
+                                                  extend_type(type);
                                                   type->attrs = append_attr_list(type->attrs, $2);
                                                 }
 acf_interface
         : acf_attributes tINTERFACE aKNOWNTYPE '{' acf_int_statements '}'
-                                                {  type_t *iface = find_type_or_error2($3, 0);
+                                                {  type_t *iface = find_type_or_error(ctx, $3, 0);
                                                    if (type_get_type(iface) != TYPE_INTERFACE)
                                                        error_loc("%s is not an interface\n", iface->name);
+                                                   extend_type(iface);
                                                    iface->attrs = append_attr_list(iface->attrs, $1);
                                                 }
 
@@ -1232,10 +1244,10 @@ static str_list_t *append_str(str_list_t *list, char *str)
     if (!str) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
-    entry = xmalloc( sizeof(*entry) );
+    entry = node_alloc( NODE_LIST, sizeof(*entry) );
     entry->str = str;
     list_add_tail( list, &entry->entry );
     return list;
@@ -1245,11 +1257,8 @@ static attr_list_t *append_attr(attr_list_t *list, attr_t *attr)
 {
     attr_t *attr_existing;
     if (!attr) return list;
-    if (!list)
-    {
-        list = xmalloc( sizeof(*list) );
-        list_init( list );
-    }
+    if (!list) list = new_attr_list();
+    attr_list_changed(list);
     LIST_FOR_EACH_ENTRY(attr_existing, list, attr_t, entry)
         if (attr_existing->type == attr->type)
         {
@@ -1270,6 +1279,7 @@ static attr_list_t *move_attr(attr_list_t *dst, attr_list_t *src, enum attr_type
     if (attr->type == type)
     {
       list_remove(&attr->entry);
+      attr_list_changed(src);
       return append_attr(dst, attr);
     }
   return dst;
@@ -1281,6 +1291,7 @@ static attr_list_t *append_attr_list(attr_list_t *new_list, attr_list_t *old_lis
 
   if (!old_list) return new_list;
 
+  attr_list_changed(old_list);
   while ((entry = list_head(old_list)))
   {
     attr_t *attr = LIST_ENTRY(entry, attr_t, entry);
@@ -1300,12 +1311,11 @@ static attr_list_t *map_attrs(const attr_list_t *list, map_attrs_filter_t filter
 
   if (!list) return NULL;
 
-  new_list = xmalloc( sizeof(*list) );
-  list_init( new_list );
+  new_list = new_attr_list();
   LIST_FOR_EACH_ENTRY(attr, list, const attr_t, entry)
   {
     if (filter && !filter(new_list, attr)) continue;
-    new_attr = xmalloc(sizeof(*new_attr));
+    new_attr = node_alloc(NODE_ATTR, sizeof(*new_attr));
     *new_attr = *attr;
     list_add_tail(new_list, &new_attr->entry);
   }
@@ -1318,7 +1328,7 @@ static decl_spec_t *make_decl_spec(type_t *type, decl_spec_t *left, decl_spec_t
   decl_spec_t *declspec = left ? left : right;
   if (!declspec)
   {
-    declspec = xmalloc(sizeof(*declspec));
+    declspec = node_alloc(NODE_DECLARATOR, sizeof(*declspec));
     declspec->type = NULL;
     declspec->stgclass = STG_NONE;
     declspec->qualifier = 0;
@@ -1334,7 +1344,7 @@ static decl_spec_t *make_decl_spec(type_t *type, decl_spec_t *left, decl_spec_t
     declspec->qualifier |= left->qualifier;
     declspec->func_specifier |= left->func_specifier;
     assert(!left->type);
-    free(left);
+    node_free(NODE_DECLARATOR, left, sizeof(*left));
   }
   if (right && declspec != right)
   {
@@ -1345,7 +1355,7 @@ static decl_spec_t *make_decl_spec(type_t *type, decl_spec_t *left, decl_spec_t
     declspec->qualifier |= right->qualifier;
     declspec->func_specifier |= right->func_specifier;
     assert(!right->type);
-    free(right);
+    node_free(NODE_DECLARATOR, right, sizeof(*right));
   }
 
   if (declspec->stgclass == STG_NONE)
@@ -1360,7 +1370,7 @@ static decl_spec_t *make_decl_spec(type_t *type, decl_spec_t *left, decl_spec_t
 
 static attr_t *make_attr(enum attr_type type)
 {
-  attr_t *a = xmalloc(sizeof(attr_t));
+  attr_t *a = node_alloc(NODE_ATTR, sizeof(attr_t));
   a->type = type;
   a->u.ival = 0;
   return a;
@@ -1368,7 +1378,7 @@ static attr_t *make_attr(enum attr_type type)
 
 static attr_t *make_attrv(enum attr_type type, unsigned int val)
 {
-  attr_t *a = xmalloc(sizeof(attr_t));
+  attr_t *a = node_alloc(NODE_ATTR, sizeof(attr_t));
   a->type = type;
   a->u.ival = val;
   return a;
@@ -1376,7 +1386,7 @@ static attr_t *make_attrv(enum attr_type type, unsigned int val)
 
 static attr_t *make_attrp(enum attr_type type, void *val)
 {
-  attr_t *a = xmalloc(sizeof(attr_t));
+  attr_t *a = node_alloc(NODE_ATTR, sizeof(attr_t));
   a->type = type;
   a->u.pval = val;
   return a;
@@ -1387,7 +1397,7 @@ static expr_list_t *append_expr(expr_list_t *list, expr_t *expr)
     if (!expr) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
     list_add_tail( list, &expr->entry );
@@ -1409,6 +1419,8 @@ static void append_array(declarator_t *decl, expr_t *expr)
     append_chain_type(decl, array, 0);
 }
 
+/* types allocated from the import arena, those of the input file are kept
+ * in its parse context */
 static struct list type_pool = LIST_INIT(type_pool);
 typedef struct
 {
@@ -1418,8 +1430,11 @@ typedef struct
 
 type_t *alloc_type(void)
 {
-  type_pool_node_t *node = xmalloc(sizeof *node);
-  list_add_tail(&type_pool, &node->link);
+  type_pool_node_t *node = node_alloc(NODE_TYPE, sizeof *node);
+  if (parse_ctx && parse_ctx->node_arena == parse_ctx->input_arena)
+    list_add_tail(&parse_ctx->input_types, &node->link);
+  else
+    list_add_tail(&type_pool, &node->link);
   return &node->data;
 }
 
@@ -1428,6 +1443,8 @@ void set_all_tfswrite(int val)
   type_pool_node_t *node;
   LIST_FOR_EACH_ENTRY(node, &type_pool, type_pool_node_t, link)
     node->data.tfswrite = val;
+  if (parse_ctx) LIST_FOR_EACH_ENTRY(node, &parse_ctx->input_types, type_pool_node_t, link)
+    node->data.tfswrite = val;
 }
 
 void clear_all_offsets(void)
@@ -1435,13 +1452,15 @@ void clear_all_offsets(void)
   type_pool_node_t *node;
   LIST_FOR_EACH_ENTRY(node, &type_pool, type_pool_node_t, link)
     node->data.typestring_offset = node->data.ptrdesc = 0;
+  if (parse_ctx) LIST_FOR_EACH_ENTRY(node, &parse_ctx->input_types, type_pool_node_t, link)
+    node->data.typestring_offset = node->data.ptrdesc = 0;
 }
 
 static void type_function_add_head_arg(type_t *type, var_t *arg)
 {
     if (!type->details.function->args)
     {
-        type->details.function->args = xmalloc( sizeof(*type->details.function->args) );
+        type->details.function->args = node_alloc( NODE_LIST, sizeof(*type->details.function->args) );
         list_init( type->details.function->args );
     }
     list_add_head( type->details.function->args, &arg->entry );
@@ -1727,9 +1746,9 @@ static var_list_t *set_var_types(attr_list_t *attrs, decl_spec_t *decl_spec, dec
   {
     var_t *var = declare_var(attrs, decl_spec, decl, 0);
     var_list = append_var(var_list, var);
-    free(decl);
+    node_free(NODE_DECLARATOR, decl, sizeof(*decl));
   }
-  free(decl_spec);
+  node_free(NODE_DECLARATOR, decl_spec, sizeof(*decl_spec));
   return var_list;
 }
 
@@ -1738,7 +1757,7 @@ static ifref_list_t *append_ifref(ifref_list_t *list, ifref_t *iface)
     if (!iface) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
     list_add_tail( list, &iface->entry );
@@ -1747,7 +1766,7 @@ static ifref_list_t *append_ifref(ifref_list_t *list, ifref_t *iface)
 
 static ifref_t *make_ifref(type_t *iface)
 {
-  ifref_t *l = xmalloc(sizeof(ifref_t));
+  ifref_t *l = node_alloc(NODE_LIST, sizeof(ifref_t));
   l->iface = iface;
   l->attrs = NULL;
   return l;
@@ -1758,7 +1777,7 @@ var_list_t *append_var(var_list_t *list, var_t *var)
     if (!var) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
     list_add_tail( list, &var->entry );
@@ -1770,7 +1789,7 @@ static var_list_t *append_var_list(var_list_t *list, var_list_t *vars)
     if (!vars) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
     list_move_tail( list, vars );
@@ -1779,11 +1798,12 @@ static var_list_t *append_var_list(var_list_t *list, var_list_t *vars)
 
 var_t *make_var(char *name)
 {
-  var_t *v = xmalloc(sizeof(var_t));
+  var_t *v = node_alloc(NODE_VAR, sizeof(var_t));
   v->name = name;
   init_declspec(&v->declspec, NULL);
   v->attrs = NULL;
   v->eval = NULL;
+  v->procstring_size = 0;
   init_loc_info(&v->loc_info);
   v->declonly = FALSE;
   return v;
@@ -1791,11 +1811,12 @@ var_t *make_var(char *name)
 
 static var_t *copy_var(var_t *src, char *name, map_attrs_filter_t attr_filter)
 {
-  var_t *v = xmalloc(sizeof(var_t));
+  var_t *v = node_alloc(NODE_VAR, sizeof(var_t));
   v->name = name;
   v->declspec = src->declspec;
   v->attrs = map_attrs(src->attrs, attr_filter);
   v->eval = src->eval;
+  v->procstring_size = 0;
   v->loc_info = src->loc_info;
   return v;
 }
@@ -1804,7 +1825,7 @@ static declarator_list_t *append_declarator(declarator_list_t *list, declarator_
 {
   if (!d) return list;
   if (!list) {
-    list = xmalloc(sizeof(*list));
+    list = node_alloc(NODE_LIST, sizeof(*list));
     list_init(list);
   }
   list_add_tail(list, &d->entry);
@@ -1813,7 +1834,7 @@ static declarator_list_t *append_declarator(declarator_list_t *list, declarator_
 
 static declarator_t *make_declarator(var_t *var)
 {
-  declarator_t *d = xmalloc(sizeof(*d));
+  declarator_t *d = node_alloc(NODE_DECLARATOR, sizeof(*d));
   d->var = var ? var : make_var(NULL);
   d->type = NULL;
   d->qualifier = 0;
@@ -1830,26 +1851,14 @@ static type_t *make_safearray(type_t *type)
 
 static typelib_t *make_library(const char *name, const attr_list_t *attrs)
 {
-    typelib_t *typelib = xmalloc(sizeof(*typelib));
+    typelib_t *typelib = node_alloc(NODE_OTHER, sizeof(*typelib));
     memset(typelib, 0, sizeof(*typelib));
-    typelib->name = xstrdup(name);
+    typelib->name = intern_string(name);
     typelib->attrs = attrs;
     list_init( &typelib->importlibs );
     return typelib;
 }
 
-static int hash_ident(const char *name)
-{
-  const char *p = name;
-  int sum = 0;
-  /* a simple sum hash is probably good enough */
-  while (*p) {
-    sum += *p;
-    p++;
-  }
-  return sum & (HASHMAX-1);
-}
-
 /***** type repository *****/
 
 static struct namespace *find_sub_namespace(struct namespace *namespace, const char *name)
@@ -1864,61 +1873,76 @@ static struct namespace *find_sub_namespace(struct namespace *namespace, const c
   return NULL;
 }
 
-static void push_namespace(const char *name)
+static void push_namespace(struct parse_context *ctx, const char *name)
 {
   struct namespace *namespace;
 
-  namespace = find_sub_namespace(current_namespace, name);
+  namespace = find_sub_namespace(ctx->current_namespace, name);
   if(!namespace) {
     namespace = xmalloc(sizeof(*namespace));
-    namespace->name = xstrdup(name);
-    namespace->parent = current_namespace;
-    list_add_tail(&current_namespace->children, &namespace->entry);
+    namespace->name = intern_string(name);
+    namespace->parent = ctx->current_namespace;
+    list_add_tail(&ctx->current_namespace->children, &namespace->entry);
     list_init(&namespace->children);
-    memset(namespace->type_hash, 0, sizeof(namespace->type_hash));
+    memset(&namespace->types, 0, sizeof(namespace->types));
   }
 
-  current_namespace = namespace;
+  ctx->current_namespace = namespace;
 }
 
-static void pop_namespace(const char *name)
+static void pop_namespace(struct parse_context *ctx, const char *name)
 {
-  assert(!strcmp(current_namespace->name, name) && current_namespace->parent);
-  current_namespace = current_namespace->parent;
+  assert(!strcmp(ctx->current_namespace->name, name) && ctx->current_namespace->parent);
+  ctx->current_namespace = ctx->current_namespace->parent;
 }
 
-static void init_lookup_namespace(const char *name)
+static void init_lookup_namespace(struct parse_context *ctx, const char *name)
 {
-    if (!(lookup_namespace = find_sub_namespace(&global_namespace, name)))
+    if (!(ctx->lookup_namespace = find_sub_namespace(&global_namespace, name)))
         error_loc("namespace '%s' not found\n", name);
 }
 
-static void push_lookup_namespace(const char *name)
+static void push_lookup_namespace(struct parse_context *ctx, const char *name)
 {
     struct namespace *namespace;
-    if (!(namespace = find_sub_namespace(lookup_namespace, name)))
+    if (!(namespace = find_sub_namespace(ctx->lookup_namespace, name)))
         error_loc("namespace '%s' not found\n", name);
-    lookup_namespace = namespace;
+    ctx->lookup_namespace = namespace;
+}
+
+/* a new parse starts out in the global namespace */
+void reset_namespaces(struct parse_context *ctx)
+{
+    ctx->current_namespace = ctx->lookup_namespace = &global_namespace;
+}
+
+/* yyerror:  yacc assumes this is not newline terminated.  */
+static void parser_error(struct parse_context *ctx, const char *message)
+{
+    error_loc("%s\n", message);
 }
 
+/* types of the same name are chained in the table of their namespace, the
+ * most recently registered first */
 struct rtype {
   const char *name;
   type_t *type;
   int t;
+  const struct import_file *import;
+  int input;  /* registered by the input file itself, not by an import or init_types() */
   struct rtype *next;
 };
 
 type_t *reg_type(type_t *type, const char *name, struct namespace *namespace, int t)
 {
-  struct rtype *nt;
-  int hash;
+  const struct import_file *import = parse_ctx ? parse_ctx->current_import : NULL;
+  struct rtype *nt, **head;
   if (!name) {
     error_loc("registering named type without name\n");
     return type;
   }
   if (!namespace)
     namespace = &global_namespace;
-  hash = hash_ident(name);
   nt = xmalloc(sizeof(struct rtype));
   nt->name = name;
   if (is_global_namespace(namespace))
@@ -1927,12 +1951,15 @@ type_t *reg_type(type_t *type, const char *name, struct namespace *namespace, in
     type->c_name = format_namespace(namespace, "__x_", "_C", name);
   nt->type = type;
   nt->t = t;
-  nt->next = namespace->type_hash[hash];
-  namespace->type_hash[hash] = nt;
+  nt->import = import;
+  nt->input = parse_ctx && !import;
+  head = (struct rtype **)symbol_table_add(&namespace->types, name);
+  nt->next = *head;
+  *head = nt;
   return type;
 }
 
-static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, attr_list_t *attrs)
+static type_t *reg_typedefs(struct parse_context *ctx, decl_spec_t *decl_spec, declarator_list_t *decls, attr_list_t *attrs)
 {
   declarator_t *decl;
   type_t *type = decl_spec->type;
@@ -1957,7 +1984,10 @@ static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, at
 
     /* replace existing attributes when generating a typelib */
     if (do_typelib)
+    {
+        extend_type(type);
         type->attrs = attrs;
+    }
   }
 
 #ifdef __REACTOS__ /* r53187 / 5bf224e */
@@ -1965,7 +1995,10 @@ static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, at
   if (type_get_type_detect_alias(type) == TYPE_UNION &&
       is_attr(attrs, ATTR_SWITCHTYPE) &&
       !is_attr(type->attrs, ATTR_SWITCHTYPE))
+  {
+    extend_type(type);
     type->attrs = append_attr(type->attrs, make_attrp(ATTR_SWITCHTYPE, get_attrp(attrs, ATTR_SWITCHTYPE)));
+  }
 #endif
 
   LIST_FOR_EACH_ENTRY( decl, decls, const declarator_t, entry )
@@ -1975,7 +2008,7 @@ static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, at
       type_t *cur;
       var_t *name;
 
-      cur = find_type(decl->var->name, current_namespace, 0);
+      cur = find_type(decl->var->name, ctx->current_namespace, 0);
 
       /*
        * MIDL allows shadowing types that are declared in imported files.
@@ -1986,7 +2019,7 @@ static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, at
        * FIXME: We may consider string separated type tables for each input
        *        for cleaner solution.
        */
-      if (cur && input_name == cur->loc_info.input_name)
+      if (cur && ctx->input_name == cur->loc_info.input_name)
           error_loc("%s: redefinition error; original definition was at %s:%d\n",
                     cur->name, cur->loc_info.input_name,
                     cur->loc_info.line_number);
@@ -1995,7 +2028,7 @@ static type_t *reg_typedefs(decl_spec_t *decl_spec, declarator_list_t *decls, at
       cur = type_new_alias(&name->declspec, name->name);
       cur->attrs = attrs;
 
-      reg_type(cur, cur->name, current_namespace, 0);
+      reg_type(cur, cur->name, ctx->current_namespace, 0);
     }
   }
   return type;
@@ -2006,23 +2039,23 @@ type_t *find_type(const char *name, struct namespace *namespace, int t)
   struct rtype *cur;
 
   if(namespace && namespace != &global_namespace) {
-    for(cur = namespace->type_hash[hash_ident(name)]; cur; cur = cur->next) {
-      if(cur->t == t && !strcmp(cur->name, name))
+    for(cur = symbol_table_find(&namespace->types, name); cur; cur = cur->next) {
+      if(cur->t == t && import_is_visible(cur->import))
         return cur->type;
     }
   }
-  for(cur = global_namespace.type_hash[hash_ident(name)]; cur; cur = cur->next) {
-    if(cur->t == t && !strcmp(cur->name, name))
+  for(cur = symbol_table_find(&global_namespace.types, name); cur; cur = cur->next) {
+    if(cur->t == t && import_is_visible(cur->import))
       return cur->type;
   }
   return NULL;
 }
 
-static type_t *find_type_or_error(const char *name, int t)
+static type_t *find_type_or_error(struct parse_context *ctx, const char *name, int t)
 {
     type_t *type;
-    if (!(type = find_type(name, current_namespace, t)) &&
-        !(type = find_type(name, lookup_namespace, t)))
+    if (!(type = find_type(name, ctx->current_namespace, t)) &&
+        !(type = find_type(name, ctx->lookup_namespace, t)))
     {
         error_loc("type '%s' not found\n", name);
         return NULL;
@@ -2030,23 +2063,16 @@ static type_t *find_type_or_error(const char *name, int t)
     return type;
 }
 
-static type_t *find_type_or_error2(char *name, int t)
-{
-  type_t *tp = find_type_or_error(name, t);
-  free(name);
-  return tp;
-}
-
-int is_type(const char *name)
+int is_type(struct parse_context *ctx, const char *name)
 {
-    return find_type(name, current_namespace, 0) != NULL ||
-           find_type(name, lookup_namespace, 0) != NULL;
+    return find_type(name, ctx->current_namespace, 0) != NULL ||
+           find_type(name, ctx->lookup_namespace, 0) != NULL;
 }
 
-int is_namespace(const char *name)
+int is_namespace(struct parse_context *ctx, const char *name)
 {
     if (!winrt_mode) return 0;
-    return find_sub_namespace(current_namespace, name) != NULL ||
+    return find_sub_namespace(ctx->current_namespace, name) != NULL ||
            find_sub_namespace(&global_namespace, name) != NULL;
 }
 
@@ -2057,10 +2083,8 @@ type_t *get_type(enum type_type type, char *name, struct namespace *namespace, i
     namespace = &global_namespace;
   if (name) {
     tp = find_type(name, namespace, t);
-    if (tp) {
-      free(name);
+    if (tp)
       return tp;
-    }
   }
   tp = make_type(type);
   tp->name = name;
@@ -2074,32 +2098,36 @@ type_t *get_type(enum type_type type, char *name, struct namespace *namespace, i
 struct rconst {
   char *name;
   var_t *var;
+  const struct import_file *import;
+  int input;
   struct rconst *next;
 };
 
-struct rconst *const_hash[HASHMAX];
+static struct symbol_table const_table;
 
 static var_t *reg_const(var_t *var)
 {
-  struct rconst *nc;
-  int hash;
+  const struct import_file *import = parse_ctx ? parse_ctx->current_import : NULL;
+  struct rconst *nc, **head;
   if (!var->name) {
     error_loc("registering constant without name\n");
     return var;
   }
-  hash = hash_ident(var->name);
   nc = xmalloc(sizeof(struct rconst));
   nc->name = var->name;
   nc->var = var;
-  nc->next = const_hash[hash];
-  const_hash[hash] = nc;
+  nc->import = import;
+  nc->input = parse_ctx && !import;
+  head = (struct rconst **)symbol_table_add(&const_table, var->name);
+  nc->next = *head;
+  *head = nc;
   return var;
 }
 
 var_t *find_const(const char *name, int f)
 {
-  struct rconst *cur = const_hash[hash_ident(name)];
-  while (cur && strcmp(cur->name, name))
+  struct rconst *cur = symbol_table_find(&const_table, name);
+  while (cur && !import_is_visible(cur->import))
     cur = cur->next;
   if (!cur) {
     if (f) error_loc("constant '%s' not found\n", name);
@@ -2110,19 +2138,192 @@ var_t *find_const(const char *name, int f)
 
 char *gen_name(void)
 {
-  static unsigned long n = 0;
-  static const char *file_id;
+  struct parse_context *ctx = parse_ctx;
 
-  if (! file_id)
+  assert(ctx);
+  if (! ctx->gen_name_id)
   {
     char *dst = dup_basename(input_idl_name, ".idl");
-    file_id = dst;
+    ctx->gen_name_id = dst;
 
     for (; *dst; ++dst)
       if (! isalnum((unsigned char) *dst))
         *dst = '_';
   }
-  return strmake("__WIDL_%s_generated_name_%08lX", file_id, n++);
+  return strmake("__WIDL_%s_generated_name_%08lX", ctx->gen_name_id, ctx->gen_name_count++);
+}
+
+static void remove_input_types(struct namespace *namespace)
+{
+  struct namespace *child;
+  struct rtype **cur, *next;
+  unsigned int i;
+
+  for (i = 0; i < namespace->types.size; i++)
+  {
+    for (cur = (struct rtype **)&namespace->types.entries[i].data; *cur; )
+    {
+      if (!(*cur)->input)
+      {
+        cur = &(*cur)->next;
+        continue;
+      }
+      next = (*cur)->next;
+      free(*cur);
+      *cur = next;
+    }
+  }
+  LIST_FOR_EACH_ENTRY(child, &namespace->children, struct namespace, entry)
+    remove_input_types(child);
+}
+
+static void reset_type_pool(struct list *pool)
+{
+  type_pool_node_t *node;
+
+  LIST_FOR_EACH_ENTRY(node, pool, type_pool_node_t, link)
+  {
+    node->data.written = FALSE;
+    node->data.user_types_registered = FALSE;
+    node->data.checked = FALSE;
+    node->data.tfswrite = FALSE;
+    node->data.typestring_offset = 0;
+    node->data.ptrdesc = 0;
+    node->data.typelib_idx = -1;
+  }
+}
+
+/* a type of an import the input file completes or adds attributes to */
+struct extended_type
+{
+  type_t *type;
+  type_t saved;  /* the type as the imports left it */
+  struct extended_type *next;
+};
+
+/* called before the file being parsed defines a type or changes its
+ * attributes; if that file is the input and the type is shared, the type
+ * is restored once the input is done, so that it does not keep pointing
+ * into the parse tree of the input and the next input sees what the
+ * imports declared.  The attribute list is copied into the input arena,
+ * since callers append to it in place and the imported list must stay
+ * as it was. */
+void extend_type(type_t *type)
+{
+  struct parse_context *ctx = parse_ctx;
+  struct extended_type *ext;
+
+  if (!ctx || ctx->current_import || arena_contains(ctx->input_arena, type)) return;
+  for (ext = ctx->extended_types; ext; ext = ext->next)
+    if (ext->type == type) return;
+  ext = xmalloc(sizeof(*ext));
+  ext->type = type;
+  ext->saved = *type;
+  ext->next = ctx->extended_types;
+  ctx->extended_types = ext;
+  type->attrs = map_attrs(type->attrs, NULL);
+}
+
+/* drop the parse tree of an input file, after restoring the shared types
+ * it extended */
+void release_input_types(struct parse_context *ctx)
+{
+  struct extended_type *ext, *next;
+
+  for (ext = ctx->extended_types; ext; ext = next)
+  {
+    next = ext->next;
+    *ext->type = ext->saved;
+    free(ext);
+  }
+  ctx->extended_types = NULL;
+  ctx->node_arena = import_arena;
+  arena_free(ctx->input_arena);
+  ctx->input_arena = NULL;
+  list_init(&ctx->input_types);
+}
+
+/* forget everything the previous input file added, in batch mode the types
+ * of its imports stay registered for the following files */
+void reset_types(void)
+{
+  struct rconst **cur, *next;
+  unsigned int i;
+
+  remove_input_types(&global_namespace);
+  for (i = 0; i < const_table.size; i++)
+  {
+    for (cur = (struct rconst **)&const_table.entries[i].data; *cur; )
+    {
+      if (!(*cur)->input)
+      {
+        cur = &(*cur)->next;
+        continue;
+      }
+      next = (*cur)->next;
+      free(*cur);
+      *cur = next;
+    }
+  }
+
+  reset_type_pool(&type_pool);
+  reset_typegen_cache();
+  reset_sltg_index_names();
+  attr_lists_frozen = FALSE;
+  list_init(&user_type_list);
+  list_init(&context_handle_list);
+  list_init(&generic_handle_list);
+}
+
+static void count_types(struct list *pool, unsigned long *counts)
+{
+  type_pool_node_t *node;
+
+  LIST_FOR_EACH_ENTRY(node, pool, type_pool_node_t, link)
+    counts[node->data.type_type]++;
+}
+
+static void dump_namespace_stats(const struct namespace *namespace, const char *prefix)
+{
+  const struct namespace *child;
+  char *name;
+
+  LIST_FOR_EACH_ENTRY(child, &namespace->children, const struct namespace, entry)
+  {
+    name = prefix ? strmake("%s.%s", prefix, child->name) : xstrdup(child->name);
+    symbol_table_dump_stats(&child->types, name);
+    dump_namespace_stats(child, name);
+    free(name);
+  }
+}
+
+void dump_symbol_stats(struct parse_context *ctx)
+{
+  static const char * const type_names[TYPE_BITFIELD + 1] =
+  {
+    "void", "basic", "enum", "struct", "encapsulated union", "union", "alias",
+    "module", "coclass", "function", "interface", "pointer", "array", "bitfield"
+  };
+  unsigned long imported[ARRAY_SIZE(type_names)] = { 0 }, input[ARRAY_SIZE(type_names)] = { 0 };
+  unsigned int i;
+
+  fprintf(stderr, "Types:\n  %-18s %8s %10s %8s %10s\n", "", "imports", "bytes", "input", "bytes");
+  count_types(&type_pool, imported);
+  count_types(&ctx->input_types, input);
+  for (i = 0; i < ARRAY_SIZE(type_names); i++)
+  {
+    if (!imported[i] && !input[i]) continue;
+    fprintf(stderr, "  %-18s %8lu %10lu %8lu %10lu\n", type_names[i],
+            imported[i], (unsigned long)(imported[i] * sizeof(type_pool_node_t)),
+            input[i], (unsigned long)(input[i] * sizeof(type_pool_node_t)));
+  }
+
+  fprintf(stderr, "Symbol tables:\n");
+  symbol_table_dump_stats(&global_namespace.types, "types");
+  dump_namespace_stats(&global_namespace, NULL);
+  symbol_table_dump_stats(&const_table, "constants");
+  intern_dump_stats();
+  arena_dump_stats(ctx->input_arena);
 }
 
 struct allowed_attr
@@ -2776,9 +2977,9 @@ static void add_explicit_handle_if_necessary(const type_t *iface, var_t *func)
         /* no explicit handle specified so add
          * "[in] handle_t IDL_handle" as the first parameter to the
          * function */
-        var_t *idl_handle = make_var(xstrdup("IDL_handle"));
+        var_t *idl_handle = make_var(intern_string("IDL_handle"));
         idl_handle->attrs = append_attr(NULL, make_attr(ATTR_IN));
-        idl_handle->declspec.type = find_type_or_error("handle_t", 0);
+        idl_handle->declspec.type = find_type("handle_t", NULL, 0);
         type_function_add_head_arg(func->declspec.type, idl_handle);
     }
 }
@@ -2969,7 +3170,7 @@ int is_valid_uuid(const char *s)
 
 static statement_t *make_statement(enum statement_type type)
 {
-    statement_t *stmt = xmalloc(sizeof(*stmt));
+    statement_t *stmt = node_alloc(NODE_STATEMENT, sizeof(*stmt));
     stmt->type = type;
     return stmt;
 }
@@ -3049,7 +3250,7 @@ static statement_t *make_statement_module(type_t *type)
     return stmt;
 }
 
-static statement_t *make_statement_typedef(declarator_list_t *decls, int declonly)
+static statement_t *make_statement_typedef(struct parse_context *ctx, declarator_list_t *decls, int declonly)
 {
     declarator_t *decl, *next;
     statement_t *stmt;
@@ -3065,14 +3266,14 @@ static statement_t *make_statement_typedef(declarator_list_t *decls, int declonl
     LIST_FOR_EACH_ENTRY_SAFE( decl, next, decls, declarator_t, entry )
     {
         var_t *var = decl->var;
-        type_t *type = find_type_or_error(var->name, 0);
-        *type_list = xmalloc(sizeof(type_list_t));
+        type_t *type = find_type_or_error(ctx, var->name, 0);
+        *type_list = node_alloc(NODE_LIST, sizeof(type_list_t));
         (*type_list)->type = type;
         (*type_list)->next = NULL;
 
         type_list = &(*type_list)->next;
-        free(decl);
-        free(var);
+        node_free(NODE_DECLARATOR, decl, sizeof(*decl));
+        node_free(NODE_VAR, var, sizeof(*var));
     }
 
     return stmt;
@@ -3091,6 +3292,8 @@ static attr_list_t *append_attribs(attr_list_t *l1, attr_list_t *l2)
     if (!l2) return l1;
     if (!l1 || l1 == l2) return l2;
     list_move_tail (l1, l2);
+    attr_list_changed(l1);
+    attr_list_changed(l2);
     return l1;
 }
 
@@ -3099,7 +3302,7 @@ static statement_list_t *append_statement(statement_list_t *list, statement_t *s
     if (!stmt) return list;
     if (!list)
     {
-        list = xmalloc( sizeof(*list) );
+        list = node_alloc( NODE_LIST, sizeof(*list) );
         list_init( list );
     }
     list_add_tail( list, &stmt->entry );
@@ -3108,9 +3311,11 @@ static statement_list_t *append_statement(statement_list_t *list, statement_t *s
 
 void init_loc_info(loc_info_t *i)
 {
-    i->input_name = input_name ? input_name : "stdin";
-    i->line_number = line_number;
-    i->near_text = parser_text;
+    const char *name = parse_ctx ? parse_ctx->input_name : input_name;
+
+    i->input_name = name ? name : "stdin";
+    i->line_number = parse_ctx ? parse_ctx->line_number : 1;
+    i->near_text = NULL;
 }
 
 static void check_def(const type_t *t)
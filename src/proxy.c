@@ -84,8 +84,7 @@ static void write_stubdesc(int expr_eval_routines)
 static void init_proxy(const statement_list_t *stmts)
 {
   if (proxy) return;
-  if(!(proxy = fopen(proxy_name, "w")))
-    error("Could not open %s for output\n", proxy_name);
+  proxy = open_output_file(proxy_name);
   print_proxy( "/*** Autogenerated by WIDL %s from %s - Do not edit ***/\n", PACKAGE_VERSION, input_name);
   print_proxy( "\n");
   print_proxy( "#define __midl_proxy\n\n");
@@ -498,10 +497,17 @@ static void write_proxy_procformatstring_offsets( const type_t *iface, int skip
     const statement_t *stmt;
     int i = 0;
 
+#ifdef __REACTOS__ /* r57019 / c3be8a3 */
     if (type_iface_get_inherit(iface))
         i = write_proxy_procformatstring_offsets( type_iface_get_inherit(iface), need_delegation(iface));
     else
         return 0;
+#else
+    if (type_iface_get_inherit(iface))
+        write_proxy_procformatstring_offsets( type_iface_get_inherit(iface), need_delegation(iface));
+    else
+        return;
+#endif
 
     STATEMENTS_FOR_EACH_FUNC( stmt, type_iface_get_stmts(iface) )
     {
@@ -976,8 +982,8 @@ static void write_proxy_routines(const statement_list_t *stmts)
   print_proxy( "#error Invalid build platform for this proxy.\n");
   print_proxy( "#endif\n");
   print_proxy( "\n");
-  write_procformatstring(proxy, stmts, need_proxy);
-  write_typeformatstring(proxy, stmts, need_proxy);
+  write_procformatstring(proxy);
+  write_typeformatstring(proxy);
 
   interfaces = sort_interfaces(stmts, &count);
   fprintf(proxy, "static const CInterfaceProxyVtbl* const _%s_ProxyVtblList[] =\n", file_id);
@@ -1085,5 +1091,6 @@ void write_proxies(const statement_list_t *stmts)
   if(!proxy) return;
 
   write_proxy_routines( stmts );
-  fclose(proxy);
+  close_output_file(proxy);
+  proxy = NULL;
 }
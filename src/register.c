@@ -260,15 +260,7 @@ void write_regscript( const statement_list_t *stmts )
         add_output_to_resources( "WINE_REGISTRY", regscript_token );
         flush_output_resources( regscript_name );
     }
-    else
-    {
-        FILE *f = fopen( regscript_name, "w" );
-        if (!f) error( "Could not open %s for output\n", regscript_name );
-        if (fwrite( output_buffer, 1, output_buffer_pos, f ) != output_buffer_pos)
-            error( "Failed to write to %s\n", regscript_name );
-        if (fclose( f ))
-            error( "Failed to write to %s\n", regscript_name );
-    }
+    else flush_text_output_buffer( regscript_name );
 }
 
 #ifndef __REACTOS__
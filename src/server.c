@@ -451,8 +451,7 @@ static void init_server(void)
 {
     if (server)
         return;
-    if (!(server = fopen(server_name, "w")))
-        error("Could not open %s for output\n", server_name);
+    server = open_output_file(server_name);
 
     print_server("/*** Autogenerated by WIDL %s from %s - Do not edit ***/\n", PACKAGE_VERSION, input_name);
     print_server("#include <string.h>\n");
@@ -538,8 +537,8 @@ static void write_server_routines(const statement_list_t *stmts)
 
     write_server_stmts(stmts, expr_eval_routines, &proc_offset);
 
-    write_procformatstring(server, stmts, need_stub);
-    write_typeformatstring(server, stmts, need_stub);
+    write_procformatstring(server);
+    write_typeformatstring(server);
 }
 
 void write_server(const statement_list_t *stmts)
@@ -554,5 +553,6 @@ void write_server(const statement_list_t *stmts)
         return;
 
     write_server_routines( stmts );
-    fclose(server);
+    close_output_file(server);
+    server = NULL;
 }
@@ -0,0 +1,171 @@
+/*
+ * Identifier hash table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "widl.h"
+#include "utils.h"
+#include "symtable.h"
+
+#define MIN_TABLE_SIZE 64
+
+/* every identifier seen by the lexer, stored once */
+static struct symbol_table strings;
+static size_t strings_bytes;
+
+unsigned int hash_string( const char *str )
+{
+    const unsigned char *p = (const unsigned char *)str;
+    unsigned int hash = 2166136261u;
+
+    /* 32-bit FNV-1a */
+    while (*p)
+    {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static struct symbol_entry *find_entry( struct symbol_table *table, const char *name, unsigned int hash )
+{
+    unsigned int mask = table->size - 1, i;
+
+    table->lookups++;
+    for (i = hash & mask; table->entries[i].name; i = (i + 1) & mask)
+    {
+        table->probes++;
+        if (table->entries[i].hash != hash) continue;
+        /* names are interned, so a match is usually the same pointer */
+        if (table->entries[i].name == name || !strcmp( table->entries[i].name, name )) break;
+    }
+    return &table->entries[i];
+}
+
+static void grow_table( struct symbol_table *table )
+{
+    struct symbol_entry *old = table->entries;
+    unsigned int old_size = table->size, mask, i, j;
+
+    table->size = old_size ? old_size * 2 : MIN_TABLE_SIZE;
+    table->entries = xmalloc( table->size * sizeof(*table->entries) );
+    memset( table->entries, 0, table->size * sizeof(*table->entries) );
+    mask = table->size - 1;
+
+    for (i = 0; i < old_size; i++)
+    {
+        if (!old[i].name) continue;
+        for (j = old[i].hash & mask; table->entries[j].name; j = (j + 1) & mask) ;
+        table->entries[j] = old[i];
+    }
+    free( old );
+}
+
+static struct symbol_entry *add_entry( struct symbol_table *table, const char *name, unsigned int hash )
+{
+    struct symbol_entry *entry;
+
+    if (table->size)
+    {
+        entry = find_entry( table, name, hash );
+        /* only grow for a new name, keeping the load factor at or below 3/4 */
+        if (entry->name || (table->count + 1) * 4 <= table->size * 3) return entry;
+    }
+    grow_table( table );
+    return find_entry( table, name, hash );
+}
+
+/* returns the unique copy of a string; it is never freed and must not be modified */
+char *intern_string( const char *str )
+{
+    unsigned int hash = hash_string( str );
+    struct symbol_entry *entry = add_entry( &strings, str, hash );
+
+    if (!entry->name)
+    {
+        entry->name = xstrdup( str );
+        entry->hash = hash;
+        strings.count++;
+        strings_bytes += strlen( str ) + 1;
+    }
+    return (char *)entry->name;
+}
+
+/* returns the data stored for a name, or NULL */
+void *symbol_table_find( struct symbol_table *table, const char *name )
+{
+    if (!table->size) return NULL;
+    return find_entry( table, name, hash_string( name ))->data;
+}
+
+static void **add_symbol( struct symbol_table *table, const char *name, char *(*copy)( const char *str ) )
+{
+    unsigned int hash = hash_string( name );
+    struct symbol_entry *entry = add_entry( table, name, hash );
+
+    if (!entry->name)
+    {
+        entry->name = copy( name );
+        entry->hash = hash;
+        entry->data = NULL;
+        table->count++;
+    }
+    return &entry->data;
+}
+
+/* returns the location of the data for a name, adding an empty entry if needed */
+void **symbol_table_add( struct symbol_table *table, const char *name )
+{
+    return add_symbol( table, name, intern_string );
+}
+
+/* same as symbol_table_add() for strings that are not identifiers, such as
+ * help strings; the table keeps its own copy instead of interning them, and
+ * has to be released with symbol_table_free_copies() */
+void **symbol_table_add_copy( struct symbol_table *table, const char *name )
+{
+    return add_symbol( table, name, xstrdup );
+}
+
+void symbol_table_free_copies( struct symbol_table *table )
+{
+    unsigned int i;
+
+    for (i = 0; i < table->size; i++) free( (char *)table->entries[i].name );
+    free( table->entries );
+    memset( table, 0, sizeof(*table) );
+}
+
+void symbol_table_dump_stats( const struct symbol_table *table, const char *name )
+{
+    if (!table->lookups) return;
+    fprintf( stderr, "  %s: %u entries in %u slots (%lu bytes), load factor %.2f, %.2f probes per lookup\n",
+             name, table->count, table->size, (unsigned long)(table->size * sizeof(*table->entries)),
+             table->size ? (double)table->count / table->size : 0.0,
+             (double)table->probes / table->lookups );
+}
+
+void intern_dump_stats( void )
+{
+    symbol_table_dump_stats( &strings, "identifiers" );
+    fprintf( stderr, "  identifier strings: %lu bytes\n", (unsigned long)strings_bytes );
+}
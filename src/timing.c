@@ -0,0 +1,291 @@
+/*
+ * Per-phase timing report
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * --------------------------------------------------------------------------------------
+ *
+ * With --time-report widl records the wall and CPU time of each phase of a
+ * compile: preprocessing and parsing of the input and of every imported
+ * file, reading the importlibs, checking, and each output generator.
+ * Phases nest, e.g. an import is parsed while its importer is, so every
+ * phase is reported both with the time of its nested phases and without
+ * it ("self"); the self times of all phases add up to the total.
+ *
+ * Output generators that run in processes of their own send their timings
+ * back through a pipe.  They run at the same time, so their times are not
+ * subtracted from the phase that waits for them.
+ */
+
+#include "config.h"
+#include "wine/config.h"
+#include "wine/port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "widl.h"
+#include "utils.h"
+#include "timing.h"
+
+enum time_report_format time_report = TIME_REPORT_NONE;
+
+struct time_entry
+{
+    char        *phase;
+    char        *file;
+    unsigned int depth;
+    int          parallel;   /* ran in a process of its own */
+    double       wall;       /* including the nested phases */
+    double       cpu;
+    double       self_wall;  /* excluding the nested phases */
+    double       self_cpu;
+};
+
+static struct time_entry *time_entries;
+static unsigned int nb_time_entries, time_entries_size;
+
+static struct
+{
+    unsigned int entry;
+    double       wall;
+    double       cpu;
+    double       nested_wall;
+    double       nested_cpu;
+} time_stack[64];
+static unsigned int time_depth;
+
+static void get_times( double *wall, double *cpu )
+{
+#ifndef _WIN32
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    *wall = ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    /* the msvcrt clock() already measures elapsed time */
+    *wall = (double)clock() / CLOCKS_PER_SEC;
+#endif
+    *cpu = (double)clock() / CLOCKS_PER_SEC;
+}
+
+static struct time_entry *add_time_entry( const char *phase, const char *file, unsigned int depth )
+{
+    struct time_entry *entry;
+
+    if (nb_time_entries == time_entries_size)
+    {
+        time_entries_size = max( 2 * time_entries_size, 64 );
+        time_entries = xrealloc( time_entries, time_entries_size * sizeof(*time_entries) );
+    }
+    entry = &time_entries[nb_time_entries++];
+    memset( entry, 0, sizeof(*entry) );
+    entry->phase = xstrdup( phase );
+    entry->file = file ? xstrdup( file ) : NULL;
+    entry->depth = depth;
+    return entry;
+}
+
+/* start timing a phase, nested in the phase currently running */
+void time_phase_start( const char *phase, const char *file )
+{
+    unsigned int depth = time_depth++;
+
+    if (!time_report || depth >= ARRAY_SIZE(time_stack)) return;
+
+    add_time_entry( phase, file, depth );
+    time_stack[depth].entry = nb_time_entries - 1;
+    time_stack[depth].nested_wall = time_stack[depth].nested_cpu = 0;
+    get_times( &time_stack[depth].wall, &time_stack[depth].cpu );
+}
+
+/* stop timing the current phase */
+void time_phase_end(void)
+{
+    unsigned int depth = --time_depth;
+    struct time_entry *entry;
+    double wall, cpu;
+
+    if (!time_report || depth >= ARRAY_SIZE(time_stack)) return;
+
+    get_times( &wall, &cpu );
+    entry = &time_entries[time_stack[depth].entry];
+    entry->wall = wall - time_stack[depth].wall;
+    entry->cpu = cpu - time_stack[depth].cpu;
+    entry->self_wall = entry->wall - time_stack[depth].nested_wall;
+    entry->self_cpu = entry->cpu - time_stack[depth].nested_cpu;
+    if (depth)
+    {
+        time_stack[depth - 1].nested_wall += entry->wall;
+        time_stack[depth - 1].nested_cpu += entry->cpu;
+    }
+}
+
+/* the entries recorded from now on are the ones a child process sends */
+unsigned int time_report_mark(void)
+{
+    return nb_time_entries;
+}
+
+/* send the entries recorded by a child process since the mark, one per line */
+void time_report_send( int fd, unsigned int mark )
+{
+    char *data = NULL, *line;
+    size_t len = 0, pos;
+    unsigned int i;
+    ssize_t ret;
+
+    if (!time_report) return;
+
+    for (i = mark; i < nb_time_entries; i++)
+    {
+        const struct time_entry *entry = &time_entries[i];
+
+        line = strmake( "%u %.9f %.9f %.9f %.9f %s\t%s\n", entry->depth, entry->wall, entry->cpu,
+                        entry->self_wall, entry->self_cpu, entry->phase,
+                        entry->file ? entry->file : "" );
+        data = xrealloc( data, len + strlen( line ) + 1 );
+        strcpy( data + len, line );
+        len += strlen( line );
+        free( line );
+    }
+    for (pos = 0; pos < len; pos += ret)
+        if ((ret = write( fd, data + pos, len - pos )) <= 0) break;
+    free( data );
+}
+
+/* add the entries sent by a child process */
+void time_report_receive( int fd )
+{
+    struct time_entry *entry;
+    char buffer[4096], *data = NULL, *line, *next, *file;
+    size_t len = 0;
+    ssize_t ret;
+    unsigned int depth;
+    double times[4];
+    int pos;
+
+    if (!time_report) return;
+
+    while ((ret = read( fd, buffer, sizeof(buffer) )) > 0)
+    {
+        data = xrealloc( data, len + ret + 1 );
+        memcpy( data + len, buffer, ret );
+        len += ret;
+    }
+    if (!data) return;
+    data[len] = 0;
+
+    for (line = data; (next = strchr( line, '\n' )); line = next + 1)
+    {
+        *next = 0;
+        if (sscanf( line, "%u %lf %lf %lf %lf %n", &depth, &times[0], &times[1],
+                    &times[2], &times[3], &pos ) != 5) continue;
+        if (!(file = strchr( line + pos, '\t' ))) continue;
+        *file++ = 0;
+        entry = add_time_entry( line + pos, *file ? file : NULL, depth );
+        entry->parallel = 1;
+        entry->wall = times[0];
+        entry->cpu = times[1];
+        entry->self_wall = times[2];
+        entry->self_cpu = times[3];
+    }
+    free( data );
+}
+
+static void write_json_string( const char *str )
+{
+    if (!str)
+    {
+        fputs( "null", stderr );
+        return;
+    }
+    fputc( '"', stderr );
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\') fprintf( stderr, "\\%c", *str );
+        else if ((unsigned char)*str < 0x20) fprintf( stderr, "\\u%04x", *str );
+        else fputc( *str, stderr );
+    }
+    fputc( '"', stderr );
+}
+
+/* print the report for an input file to stderr, and start over for the next one */
+void write_time_report( const char *input )
+{
+    double wall = 0, cpu = 0;
+    unsigned int i;
+
+    if (!time_report) return;
+
+    for (i = 0; i < nb_time_entries; i++)
+    {
+        if (time_entries[i].depth) continue;
+        wall += time_entries[i].wall;
+        cpu += time_entries[i].cpu;
+    }
+
+    if (time_report == TIME_REPORT_JSON)
+    {
+        /* one object per line, so that batch mode outputs JSON lines */
+        fputs( "{\"input\":", stderr );
+        write_json_string( input );
+        fprintf( stderr, ",\"wall\":%.6f,\"cpu\":%.6f,\"phases\":[", wall, cpu );
+        for (i = 0; i < nb_time_entries; i++)
+        {
+            const struct time_entry *entry = &time_entries[i];
+
+            fputs( i ? ",{\"phase\":" : "{\"phase\":", stderr );
+            write_json_string( entry->phase );
+            fputs( ",\"file\":", stderr );
+            write_json_string( entry->file );
+            fprintf( stderr, ",\"depth\":%u,\"parallel\":%s,\"wall\":%.6f,\"cpu\":%.6f,"
+                     "\"self_wall\":%.6f,\"self_cpu\":%.6f}", entry->depth,
+                     entry->parallel ? "true" : "false", entry->wall, entry->cpu,
+                     entry->self_wall, entry->self_cpu );
+        }
+        fputs( "]}\n", stderr );
+    }
+    else
+    {
+        fprintf( stderr, "Time report for %s (milliseconds):\n", input );
+        fprintf( stderr, "      wall        cpu  self wall   self cpu  phase\n" );
+        for (i = 0; i < nb_time_entries; i++)
+        {
+            const struct time_entry *entry = &time_entries[i];
+
+            fprintf( stderr, "%10.3f %10.3f %10.3f %10.3f  %*s%s%s%s%s\n",
+                     entry->wall * 1000, entry->cpu * 1000,
+                     entry->self_wall * 1000, entry->self_cpu * 1000,
+                     entry->depth * 2, "", entry->phase,
+                     entry->file ? " " : "", entry->file ? entry->file : "",
+                     entry->parallel ? " (parallel)" : "" );
+        }
+        fprintf( stderr, "%10.3f %10.3f %21s  total\n", wall * 1000, cpu * 1000, "" );
+    }
+    fflush( stderr );
+
+    for (i = 0; i < nb_time_entries; i++)
+    {
+        free( time_entries[i].phase );
+        free( time_entries[i].file );
+    }
+    nb_time_entries = 0;
+}
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 
 #include "widl.h"
@@ -50,6 +51,37 @@ static const type_t *current_structure;
 static const var_t *current_func;
 static const type_t *current_iface;
 
+/* The format strings are generated once into memory, before the stubs that
+ * refer to them.  A struct that refers to itself through a pointer only gets
+ * its offset once it is complete, so the references written while it is in
+ * progress are kept as fixups and printed when the text is copied out. */
+#define TFS_PENDING 0x80000000
+
+struct format_fixup
+{
+    size_t        pos;      /* position of the reference in the text */
+    const type_t *type;     /* referenced type */
+    unsigned int  addend;   /* added to the offset of the type */
+    unsigned int  base;     /* offset the reference is relative to */
+    unsigned int  absoff;   /* referenced offset, once resolved */
+    int           ptrdesc;  /* reference to the pointer layout of a struct */
+};
+
+struct format_string
+{
+    char                *text;
+    size_t               text_size;
+    unsigned int         size;      /* size of the format string in bytes */
+    struct format_fixup *fixups;
+    unsigned int         count;
+    unsigned int         alloc;
+};
+
+static struct format_string type_format;
+static struct format_string proc_format;
+static const type_t **pending_types;
+static unsigned int pending_count, pending_alloc;
+
 static struct list expr_eval_routines = LIST_INIT(expr_eval_routines);
 struct expr_eval_routine
 {
@@ -98,6 +130,11 @@ static unsigned int get_required_buffer_size_type( const type_t *type, const cha
                                                    const attr_list_t *attrs, int toplevel_param,
                                                    unsigned int *alignment );
 static unsigned int get_function_buffer_size( const var_t *func, enum pass pass );
+static unsigned int process_tfs(FILE *file, const statement_list_t *stmts, type_pred_t pred);
+static void write_iface_procformatstring(type_t *iface, FILE *file, int indent, unsigned int *offset);
+static void for_each_iface(const statement_list_t *stmts,
+                           void (*proc)(type_t *iface, FILE *file, int indent, unsigned int *offset),
+                           type_pred_t pred, FILE *file, int indent, unsigned int *offset);
 
 static const char *string_of_type(unsigned char type)
 {
@@ -328,7 +365,118 @@ static int is_user_type(const type_t *t)
     return get_user_type(t, NULL) != NULL;
 }
 
-enum typegen_type typegen_detect_type(const type_t *type, const attr_list_t *attrs, unsigned int flags)
+/* The derived properties of a type only change while it is being parsed, so
+ * once the attribute lists are frozen they are cached until the next input.
+ * Pointer types depend on the pointer_default of the current interface, the
+ * properties derived from them are kept per type and pointer_default, the
+ * others per type only. */
+#define ANY_POINTER_DEFAULT 0x100
+
+struct typegen_cache
+{
+    struct typegen_cache *next;
+    const type_t *type;
+    unsigned int pointer_default;   /* FC_* of the interface, 0 if none, or ANY_POINTER_DEFAULT */
+    unsigned int memsize;
+    unsigned char align;
+    unsigned char buffer_align;
+    unsigned char struct_fc;
+    unsigned char detect_type[4];   /* typegen_type + 1, by TDT_IGNORE_STRINGS/RANGES */
+    unsigned int layout_valid : 1;
+    unsigned int buffer_align_valid : 1;
+    unsigned int struct_fc_valid : 1;
+    unsigned int filled : 1;            /* done by fill_typegen_cache */
+    unsigned int has_pointers : 2;      /* 0 if unknown, else boolean + 1 */
+    unsigned int has_full_pointer : 2;  /* 0 if unknown, else boolean + 1 */
+};
+
+static struct typegen_cache **typegen_cache;
+static unsigned int typegen_cache_size, typegen_cache_count;
+
+static unsigned int hash_typegen_cache(const type_t *type, unsigned int pointer_default)
+{
+    return ((unsigned int)((size_t)type >> 4) ^ pointer_default) * 2654435761u;
+}
+
+/* entries are allocated one by one so that they stay put while the table grows */
+static struct typegen_cache *find_typegen_cache(const type_t *type, unsigned int pointer_default)
+{
+    struct typegen_cache *cache, *next;
+    unsigned int i, hash;
+
+    if (!attr_lists_frozen) return NULL;
+    if (typegen_cache_size)
+    {
+        hash = hash_typegen_cache(type, pointer_default) & (typegen_cache_size - 1);
+        for (cache = typegen_cache[hash]; cache; cache = cache->next)
+            if (cache->type == type && cache->pointer_default == pointer_default) return cache;
+    }
+
+    if (typegen_cache_count >= typegen_cache_size * 3 / 4)
+    {
+        struct typegen_cache **old = typegen_cache;
+        unsigned int old_size = typegen_cache_size;
+
+        typegen_cache_size = max(typegen_cache_size * 2, 256);
+        typegen_cache = xmalloc(typegen_cache_size * sizeof(*typegen_cache));
+        memset(typegen_cache, 0, typegen_cache_size * sizeof(*typegen_cache));
+        for (i = 0; i < old_size; i++)
+        {
+            for (cache = old[i]; cache; cache = next)
+            {
+                next = cache->next;
+                hash = hash_typegen_cache(cache->type, cache->pointer_default) & (typegen_cache_size - 1);
+                cache->next = typegen_cache[hash];
+                typegen_cache[hash] = cache;
+            }
+        }
+        free(old);
+    }
+
+    cache = xmalloc(sizeof(*cache));
+    memset(cache, 0, sizeof(*cache));
+    cache->type = type;
+    cache->pointer_default = pointer_default;
+    hash = hash_typegen_cache(type, pointer_default) & (typegen_cache_size - 1);
+    cache->next = typegen_cache[hash];
+    typegen_cache[hash] = cache;
+    typegen_cache_count++;
+    return cache;
+}
+
+/* the properties that do not depend on the current interface */
+static struct typegen_cache *get_typegen_cache(const type_t *type)
+{
+    return find_typegen_cache(type, ANY_POINTER_DEFAULT);
+}
+
+/* the properties that depend on the pointer_default of the current interface */
+static struct typegen_cache *get_iface_typegen_cache(const type_t *type)
+{
+    return find_typegen_cache(type, current_iface ? get_attrv(current_iface->attrs, ATTR_POINTERDEFAULT) : 0);
+}
+
+/* forget the cached properties, the types of the next input may reuse the
+ * memory of the current ones */
+void reset_typegen_cache(void)
+{
+    struct typegen_cache *cache, *next;
+    unsigned int i;
+
+    for (i = 0; i < typegen_cache_size; i++)
+    {
+        for (cache = typegen_cache[i]; cache; cache = next)
+        {
+            next = cache->next;
+            free(cache);
+        }
+    }
+    free(typegen_cache);
+    typegen_cache = NULL;
+    typegen_cache_size = typegen_cache_count = 0;
+}
+
+static enum typegen_type detect_type_no_attrs(const type_t *type, unsigned int flags)
 {
     if (is_user_type(type))
         return TGT_USER_TYPE;
@@ -336,24 +484,21 @@ enum typegen_type typegen_detect_type(const type_t *type, const attr_list_t *att
     if (is_aliaschain_attr(type, ATTR_CONTEXTHANDLE))
         return TGT_CTXT_HANDLE;
 
-    if (!(flags & TDT_IGNORE_STRINGS) && is_string_type(attrs, type))
+    if (!(flags & TDT_IGNORE_STRINGS) && is_string_type(NULL, type))
         return TGT_STRING;
 
     switch (type_get_type(type))
     {
     case TYPE_BASIC:
-        if (!(flags & TDT_IGNORE_RANGES) &&
-            (is_attr(attrs, ATTR_RANGE) || is_aliaschain_attr(type, ATTR_RANGE)))
+        if (!(flags & TDT_IGNORE_RANGES) && is_aliaschain_attr(type, ATTR_RANGE))
             return TGT_RANGE;
         return TGT_BASIC;
     case TYPE_ENUM:
-        if (!(flags & TDT_IGNORE_RANGES) &&
-            (is_attr(attrs, ATTR_RANGE) || is_aliaschain_attr(type, ATTR_RANGE)))
+        if (!(flags & TDT_IGNORE_RANGES) && is_aliaschain_attr(type, ATTR_RANGE))
             return TGT_RANGE;
         return TGT_ENUM;
     case TYPE_POINTER:
-        if (type_get_type(type_pointer_get_ref_type(type)) == TYPE_INTERFACE ||
-            (type_get_type(type_pointer_get_ref_type(type)) == TYPE_VOID && is_attr(attrs, ATTR_IIDIS)))
+        if (type_get_type(type_pointer_get_ref_type(type)) == TYPE_INTERFACE)
             return TGT_IFACE_POINTER;
         else if (is_aliaschain_attr(type_pointer_get_ref_type(type), ATTR_CONTEXTHANDLE))
             return TGT_CTXT_HANDLE_POINTER;
@@ -378,6 +523,52 @@ enum typegen_type typegen_detect_type(const type_t *type, const attr_list_t *att
     return TGT_INVALID;
 }
 
+enum typegen_type typegen_detect_type(const type_t *type, const attr_list_t *attrs, unsigned int flags)
+{
+    struct typegen_cache *cache = get_typegen_cache(type);
+    unsigned int slot = (flags & (TDT_IGNORE_STRINGS | TDT_IGNORE_RANGES)) >> 1;
+    enum typegen_type ret;
+
+    if (cache && cache->detect_type[slot])
+        ret = cache->detect_type[slot] - 1;
+    else
+    {
+        ret = detect_type_no_attrs(type, flags);
+        if (cache) cache->detect_type[slot] = ret + 1;
+    }
+    if (!attrs) return ret;
+
+    /* apply the attributes of the field or parameter in the same order as above */
+    switch (ret)
+    {
+    case TGT_USER_TYPE:
+    case TGT_CTXT_HANDLE:
+    case TGT_STRING:
+        return ret;
+    default:
+        break;
+    }
+    if (!(flags & TDT_IGNORE_STRINGS) && is_string_type(attrs, type))
+        return TGT_STRING;
+
+    switch (ret)
+    {
+    case TGT_BASIC:
+    case TGT_ENUM:
+        if (!(flags & TDT_IGNORE_RANGES) && is_attr(attrs, ATTR_RANGE))
+            return TGT_RANGE;
+        break;
+    case TGT_POINTER:
+    case TGT_CTXT_HANDLE_POINTER:
+        if (type_get_type(type_pointer_get_ref_type(type)) == TYPE_VOID && is_attr(attrs, ATTR_IIDIS))
+            return TGT_IFACE_POINTER;
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
 static int cant_be_null(const var_t *v)
 {
     switch (typegen_detect_type(v->declspec.type, v->attrs, TDT_IGNORE_STRINGS))
@@ -481,7 +672,7 @@ static unsigned int get_rpc_flags( const attr_list_t *attrs )
     return flags;
 }
 
-unsigned char get_struct_fc(const type_t *type)
+static unsigned char compute_struct_fc(const type_t *type)
 {
   int has_pointer = 0;
   int has_conformance = 0;
@@ -620,6 +811,21 @@ unsigned char get_struct_fc(const type_t *type)
   return FC_STRUCT;
 }
 
+unsigned char get_struct_fc(const type_t *type)
+{
+    struct typegen_cache *cache = get_iface_typegen_cache(type);
+    unsigned char fc;
+
+    if (cache && cache->struct_fc_valid) return cache->struct_fc;
+    fc = compute_struct_fc(type);
+    if (cache)
+    {
+        cache->struct_fc = fc;
+        cache->struct_fc_valid = 1;
+    }
+    return fc;
+}
+
 static unsigned char get_array_fc(const type_t *type)
 {
     unsigned char fc;
@@ -706,7 +912,20 @@ static int is_non_complex_struct(const type_t *type)
             get_struct_fc(type) != FC_BOGUS_STRUCT);
 }
 
+static int compute_has_pointers(const type_t *type);
+
 static int type_has_pointers(const type_t *type)
+{
+    struct typegen_cache *cache = get_typegen_cache(type);
+    int ret;
+
+    if (cache && cache->has_pointers) return cache->has_pointers - 1;
+    ret = compute_has_pointers(type);
+    if (cache) cache->has_pointers = ret + 1;
+    return ret;
+}
+
+static int compute_has_pointers(const type_t *type)
 {
     switch (typegen_detect_type(type, NULL, TDT_IGNORE_STRINGS))
     {
@@ -753,8 +972,26 @@ static int type_has_pointers(const type_t *type)
     return FALSE;
 }
 
+static int compute_has_full_pointer(const type_t *type, const attr_list_t *attrs,
+                                    int toplevel_param);
+
+/* only the common case of a type without field attributes is cached */
 static int type_has_full_pointer(const type_t *type, const attr_list_t *attrs,
                                  int toplevel_param)
+{
+    struct typegen_cache *cache;
+    int ret;
+
+    if (attrs || toplevel_param || !(cache = get_iface_typegen_cache(type)))
+        return compute_has_full_pointer(type, attrs, toplevel_param);
+    if (cache->has_full_pointer) return cache->has_full_pointer - 1;
+    ret = compute_has_full_pointer(type, NULL, FALSE);
+    cache->has_full_pointer = ret + 1;
+    return ret;
+}
+
+static int compute_has_full_pointer(const type_t *type, const attr_list_t *attrs,
+                                    int toplevel_param)
 {
     switch (typegen_detect_type(type, NULL, TDT_IGNORE_STRINGS))
     {
@@ -831,11 +1068,19 @@ static void guard_rec(type_t *type)
 {
     /* types that contain references to themselves (like a linked list),
        need to be shielded from infinite recursion when writing embedded
-       types  */
+       types; references to them get fixed up once they are written  */
     if (type->typestring_offset)
         type->tfswrite = FALSE;
     else
-        type->typestring_offset = 1;
+    {
+        if (pending_count == pending_alloc)
+        {
+            pending_alloc = pending_alloc ? 2 * pending_alloc : 16;
+            pending_types = xrealloc(pending_types, pending_alloc * sizeof(*pending_types));
+        }
+        pending_types[pending_count] = type;
+        type->typestring_offset = TFS_PENDING | pending_count++;
+    }
 }
 
 static int is_embedded_complex(const type_t *type)
@@ -887,9 +1132,8 @@ void print(FILE *file, int indent, const char *format, va_list va)
     if (file)
     {
         if (format[0] != '\n')
-            while (0 < indent--)
-                fprintf(file, "    ");
-        vfprintf(file, format, va);
+            output_indent(file, indent);
+        output_vprintf(file, format, va);
     }
 }
 
@@ -932,15 +1176,140 @@ static void write_formatdesc(FILE *f, int indent, const char *str)
     print_file(f, indent, "\n");
 }
 
-void write_formatstringsdecl(FILE *f, int indent, const statement_list_t *stmts, type_pred_t pred)
+static void add_format_fixup(FILE *file, const type_t *type, unsigned int base, unsigned int addend,
+                             int ptrdesc)
 {
+    struct format_fixup *fixup;
+
+    if (type_format.count == type_format.alloc)
+    {
+        type_format.alloc = type_format.alloc ? 2 * type_format.alloc : 16;
+        type_format.fixups = xrealloc(type_format.fixups,
+                                      type_format.alloc * sizeof(*type_format.fixups));
+    }
+    fixup = &type_format.fixups[type_format.count++];
+    fixup->pos = ftell(file);
+    fixup->type = type;
+    fixup->addend = addend;
+    fixup->base = base;
+    fixup->absoff = 0;
+    fixup->ptrdesc = ptrdesc;
+}
+
+static void print_offset(FILE *file, unsigned int absoff, unsigned int base)
+{
+    short reloff = absoff - base;
+    print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n", reloff, reloff, absoff);
+}
+
+/* write a reference to the type format string at absoff + addend, relative
+ * to base; a pending absoff is no offset yet, so the addend goes in the fixup */
+static void write_tfs_offset(FILE *file, unsigned int absoff, unsigned int addend, unsigned int base)
+{
+    if (!(absoff & TFS_PENDING))
+        print_offset(file, absoff + addend, base);
+    else if (file)
+        add_format_fixup(file, pending_types[absoff & ~TFS_PENDING], base, addend, FALSE);
+}
+
+static FILE *open_format_string(struct format_string *fs)
+{
+    FILE *file;
+
+    free(fs->text);
+    fs->text = NULL;
+    fs->text_size = 0;
+    fs->size = 0;
+    fs->count = 0;
+#ifndef _WIN32
+    file = open_memstream(&fs->text, &fs->text_size);
+#else
+    file = tmpfile();
+#endif
+    if (!file) error("Could not create format string buffer: %s\n", strerror(errno));
+    return file;
+}
+
+static void close_format_string(struct format_string *fs, FILE *file)
+{
+#ifdef _WIN32
+    rewind(file);
+    fs->text = read_file_data(file, &fs->text_size);
+    if (!fs->text) error("Could not read format string buffer\n");
+#endif
+    if (fclose(file)) error("Could not write format string buffer\n");
+}
+
+/* copy a format string to the output, filling in its fixups */
+static void write_format_string(FILE *file, const struct format_string *fs)
+{
+    const struct format_fixup *fixup;
+    size_t pos = 0;
+    unsigned int i;
+
+    for (i = 0; i < fs->count; i++)
+    {
+        fixup = &fs->fixups[i];
+        fwrite(fs->text + pos, 1, fixup->pos - pos, file);
+        pos = fixup->pos;
+        if (fixup->ptrdesc)
+        {
+            int reloff = fixup->absoff - fixup->base;
+            print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %d (%u) */\n",
+                       (unsigned short)reloff, reloff, fixup->absoff);
+        }
+        else
+            print_offset(file, fixup->absoff, fixup->base);
+    }
+    fwrite(fs->text + pos, 1, fs->text_size - pos, file);
+}
+
+static void build_typeformatstring(const statement_list_t *stmts, type_pred_t pred)
+{
+    FILE *file = open_format_string(&type_format);
+    struct format_fixup *fixup;
+    unsigned int i;
+
     clear_all_offsets();
+    set_all_tfswrite(FALSE);
+    pending_count = 0;
+    type_format.size = process_tfs(file, stmts, pred);
+    close_format_string(&type_format, file);
 
-    print_file(f, indent, "#define TYPE_FORMAT_STRING_SIZE %d\n",
-               get_size_typeformatstring(stmts, pred));
+    for (i = 0; i < type_format.count; i++)
+    {
+        fixup = &type_format.fixups[i];
+        if (fixup->ptrdesc)
+        {
+            fixup->absoff = fixup->type->ptrdesc ? fixup->type->ptrdesc : fixup->base;
+            assert(fixup->absoff >= fixup->base);
+        }
+        else
+        {
+            assert(!(fixup->type->typestring_offset & TFS_PENDING));
+            fixup->absoff = fixup->type->typestring_offset + fixup->addend;
+        }
+    }
+}
 
-    print_file(f, indent, "#define PROC_FORMAT_STRING_SIZE %d\n",
-               get_size_procformatstring(stmts, pred));
+static void build_procformatstring(const statement_list_t *stmts, type_pred_t pred)
+{
+    FILE *file = open_format_string(&proc_format);
+    unsigned int offset = 0;
+
+    for_each_iface(stmts, write_iface_procformatstring, pred, file, 2, &offset);
+    proc_format.size = offset + 1;
+    close_format_string(&proc_format, file);
+}
+
+void write_formatstringsdecl(FILE *f, int indent, const statement_list_t *stmts, type_pred_t pred)
+{
+    /* the proc format string refers to the final type offsets */
+    build_typeformatstring(stmts, pred);
+    build_procformatstring(stmts, pred);
+
+    print_file(f, indent, "#define TYPE_FORMAT_STRING_SIZE %d\n", type_format.size);
+    print_file(f, indent, "#define PROC_FORMAT_STRING_SIZE %d\n", proc_format.size);
 
     fprintf(f, "\n");
     write_formatdesc(f, indent, "TYPE");
@@ -1510,14 +1879,15 @@ static void write_iface_procformatstring(type_t *iface, FILE *file, int indent,
     {
         var_t *func = stmt->u.var;
         if (is_local(func->attrs)) continue;
+        func->procstring_offset = *offset;
         write_procformatstring_func( file, indent, iface, func, offset, count++ );
+        func->procstring_size = *offset - func->procstring_offset;
     }
 }
 
-void write_procformatstring(FILE *file, const statement_list_t *stmts, type_pred_t pred)
+void write_procformatstring(FILE *file)
 {
     int indent = 0;
-    unsigned int offset = 0;
 
     print_file(file, indent, "static const MIDL_PROC_FORMAT_STRING __MIDL_ProcFormatString =\n");
     print_file(file, indent, "{\n");
@@ -1526,7 +1896,7 @@ void write_procformatstring(FILE *file, const statement_list_t *stmts, type_pred
     print_file(file, indent, "{\n");
     indent++;
 
-    for_each_iface(stmts, write_iface_procformatstring, pred, file, indent, &offset);
+    write_format_string(file, &proc_format);
 
     print_file(file, indent, "0x0\n");
     indent--;
@@ -1867,7 +2237,7 @@ static unsigned int union_memsize(const var_list_t *fields, unsigned int *pmaxa)
     return maxs;
 }
 
-unsigned int type_memsize_and_alignment(const type_t *t, unsigned int *align)
+static unsigned int compute_memsize_and_alignment(const type_t *t, unsigned int *align)
 {
     unsigned int size = 0;
 
@@ -1976,13 +2346,50 @@ unsigned int type_memsize_and_alignment(const type_t *t, unsigned int *align)
     return size;
 }
 
+/* the layout of structures and unions also depends on the alignment passed
+ * in, so only the layout of the type on its own is cached */
+unsigned int type_memsize_and_alignment(const type_t *t, unsigned int *align)
+{
+    struct typegen_cache *cache;
+    unsigned int size, a = 0;
+
+    if (*align || !(cache = get_typegen_cache(t)))
+        return compute_memsize_and_alignment(t, align);
+    if (!cache->layout_valid)
+    {
+        cache->memsize = compute_memsize_and_alignment(t, &a);
+        cache->align = a;
+        cache->layout_valid = 1;
+    }
+    size = cache->memsize;
+    *align = cache->align;
+    return size;
+}
+
 unsigned int type_memsize(const type_t *t)
 {
     unsigned int align = 0;
     return type_memsize_and_alignment( t, &align );
 }
 
+static unsigned int compute_buffer_alignment(const type_t *t);
+
 static unsigned int type_buffer_alignment(const type_t *t)
+{
+    struct typegen_cache *cache = get_typegen_cache(t);
+    unsigned int align;
+
+    if (cache && cache->buffer_align_valid) return cache->buffer_align;
+    align = compute_buffer_alignment(t);
+    if (cache)
+    {
+        cache->buffer_align = align;
+        cache->buffer_align_valid = 1;
+    }
+    return align;
+}
+
+static unsigned int compute_buffer_alignment(const type_t *t)
 {
     const var_list_t *fields;
     const var_t *var;
@@ -2109,7 +2516,6 @@ static unsigned int write_nonsimple_pointer(FILE *file, const attr_list_t *attrs
                                             unsigned int *typeformat_offset)
 {
     unsigned int start_offset = *typeformat_offset;
-    short reloff = offset - (*typeformat_offset + 2);
     int in_attr, out_attr;
     int pointer_type;
     unsigned char flags = 0;
@@ -2168,7 +2574,7 @@ static unsigned int write_nonsimple_pointer(FILE *file, const attr_list_t *attrs
         fprintf(file, " */\n");
     }
 
-    print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n", reloff, reloff, offset);
+    write_tfs_offset(file, offset, 0, start_offset + 2);
     *typeformat_offset += 4;
 
     return start_offset;
@@ -2284,7 +2690,6 @@ static unsigned int write_user_tfs(FILE *file, type_t *type, unsigned int *tfsof
     unsigned int ualign = type_buffer_alignment(utype);
     unsigned int size = type_memsize(type);
     unsigned short funoff = user_type_offset(name);
-    short reloff;
 
     if (processed(type)) return type->typestring_offset;
 
@@ -2332,8 +2737,7 @@ static unsigned int write_user_tfs(FILE *file, type_t *type, unsigned int *tfsof
     print_file(file, 2, "NdrFcShort(0x%hx),\t/* %u */\n", (unsigned short)size, size);
     print_file(file, 2, "NdrFcShort(0x%hx),\t/* %u */\n", (unsigned short)usize, usize);
     *tfsoff += 8;
-    reloff = absoff - *tfsoff;
-    print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n", reloff, reloff, absoff);
+    write_tfs_offset(file, absoff, 0, *tfsoff);
     *tfsoff += 2;
     return start;
 }
@@ -2346,7 +2750,6 @@ static void write_member_type(FILE *file, const type_t *cont,
     if (is_embedded_complex(type) && !is_conformant_array(type))
     {
         unsigned int absoff;
-        short reloff;
 
         if (type_get_type(type) == TYPE_UNION && is_attr(attrs, ATTR_SWITCHIS))
         {
@@ -2357,15 +2760,13 @@ static void write_member_type(FILE *file, const type_t *cont,
         {
             absoff = type->typestring_offset;
         }
-        reloff = absoff - (*tfsoff + 2);
 
         print_file(file, 2, "0x4c,\t/* FC_EMBEDDED_COMPLEX */\n");
         /* padding is represented using FC_STRUCTPAD* types, so presumably
          * this is left over in the format for historical purposes in MIDL
          * or rpcrt4. */
         print_file(file, 2, "0x0,\n");
-        print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n",
-                   reloff, reloff, absoff);
+        write_tfs_offset(file, absoff, 0, *tfsoff + 2);
         *tfsoff += 4;
     }
     else if (is_ptr(type) || is_conformant_array(type))
@@ -2431,18 +2832,15 @@ static void write_descriptors(FILE *file, type_t *type, unsigned int *tfsoff)
         unsigned int size = field_memsize( ft, &offset );
         if (type_get_type(ft) == TYPE_UNION && is_attr(f->attrs, ATTR_SWITCHIS))
         {
-            short reloff;
-            unsigned int absoff = ft->typestring_offset;
+            unsigned int skip = 0;
             if (is_attr(ft->attrs, ATTR_SWITCHTYPE))
-                absoff += 8; /* we already have a corr descr, skip it */
-            reloff = absoff - (*tfsoff + 6);
+                skip = 8; /* we already have a corr descr, skip it */
             print_file(file, 0, "/* %d */\n", *tfsoff);
             print_file(file, 2, "0x%x,\t/* FC_NON_ENCAPSULATED_UNION */\n", FC_NON_ENCAPSULATED_UNION);
             print_file(file, 2, "0x%x,\t/* FIXME: always FC_LONG */\n", FC_LONG);
             write_conf_or_var_desc(file, current_structure, offset, ft,
                                    get_attrp(f->attrs, ATTR_SWITCHIS));
-            print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n",
-                       (unsigned short)reloff, reloff, absoff);
+            write_tfs_offset(file, ft->typestring_offset, skip, *tfsoff + 6);
             *tfsoff += 8;
         }
         offset += size;
@@ -3180,10 +3578,7 @@ static unsigned int write_struct_tfs(FILE *file, type_t *type,
 
     if (array)
     {
-        unsigned int absoff = array->declspec.type->typestring_offset;
-        short reloff = absoff - *tfsoff;
-        print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n",
-                   reloff, reloff, absoff);
+        write_tfs_offset(file, array->declspec.type->typestring_offset, 0, *tfsoff);
         *tfsoff += 2;
     }
     else if (fc == FC_BOGUS_STRUCT)
@@ -3194,14 +3589,9 @@ static unsigned int write_struct_tfs(FILE *file, type_t *type,
 
     if (fc == FC_BOGUS_STRUCT)
     {
-        /* On the sizing pass, type->ptrdesc may be zero, but it's ok as
-           nothing is written to file yet.  On the actual writing pass,
-           this will have been updated.  */
-        unsigned int absoff = type->ptrdesc ? type->ptrdesc : *tfsoff;
-        int reloff = absoff - *tfsoff;
-        assert( reloff >= 0 );
-        print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %d (%u) */\n",
-                   (unsigned short)reloff, reloff, absoff);
+        /* the pointer layout follows the members, so type->ptrdesc is only
+           known once they are written */
+        if (file) add_format_fixup(file, type, *tfsoff, 0, TRUE);
         *tfsoff += 2;
     }
     else if ((fc == FC_PSTRUCT) ||
@@ -3283,11 +3673,7 @@ static void write_branch_type(FILE *file, const type_t *t, unsigned int *tfsoff)
                        fc, string_of_type(fc));
         }
         else if (t->typestring_offset)
-        {
-            short reloff = t->typestring_offset - *tfsoff;
-            print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %d (%d) */\n",
-                       reloff, reloff, t->typestring_offset);
-        }
+            write_tfs_offset(file, t->typestring_offset, 0, *tfsoff);
         else
             error("write_branch_type: type unimplemented %d\n", type_get_type(t));
     }
@@ -3614,14 +4000,11 @@ static unsigned int write_type_tfs(FILE *file, const attr_list_t *attrs,
             if (type_array_is_decl_as_ptr(type)
                     || (ptr_type != FC_RP && context == TYPE_CONTEXT_TOPLEVELPARAM))
             {
-                unsigned int absoff = type->typestring_offset;
-                short reloff = absoff - (*typeformat_offset + 2);
                 off = *typeformat_offset;
                 print_file(file, 0, "/* %d */\n", off);
                 print_file(file, 2, "0x%x, 0x0,\t/* %s */\n", ptr_type,
                            string_of_type(ptr_type));
-                print_file(file, 2, "NdrFcShort(0x%hx),\t/* Offset= %hd (%u) */\n",
-                           reloff, reloff, absoff);
+                write_tfs_offset(file, type->typestring_offset, 0, off + 2);
                 if (ptr_type != FC_RP) update_tfsoff( type, off, file );
                 *typeformat_offset += 4;
             }
@@ -3749,8 +4132,77 @@ static unsigned int process_tfs(FILE *file, const statement_list_t *stmts, type_
     return typeformat_offset + 1;
 }
 
+/* compute what the type format strings need to know about the structures
+ * and unions a method passes, along with the ones they contain */
+static void fill_type_cache(const type_t *type)
+{
+    struct typegen_cache *cache = get_iface_typegen_cache(type);
+    const var_list_t *fields = NULL;
+    const var_t *field;
+
+    if (!cache || cache->filled) return;
+    cache->filled = 1;
+
+    switch (typegen_detect_type(type, NULL, TDT_IGNORE_STRINGS))
+    {
+    case TGT_POINTER:
+        fill_type_cache(type_pointer_get_ref_type(type));
+        return;
+    case TGT_ARRAY:
+        fill_type_cache(type_array_get_element_type(type));
+        return;
+    case TGT_STRUCT:
+        get_struct_fc(type);
+        fields = type_struct_get_fields(type);
+        break;
+    case TGT_UNION:
+        fields = type_union_get_cases(type);
+        break;
+    default:
+        return;
+    }
+
+    type_memsize(type);
+    type_has_pointers(type);
+    type_has_full_pointer(type, NULL, FALSE);
+    if (fields) LIST_FOR_EACH_ENTRY( field, fields, const var_t, entry )
+        if (field->declspec.type) fill_type_cache(field->declspec.type);
+}
+
+static void fill_iface_cache(type_t *iface, FILE *file, int indent, unsigned int *offset)
+{
+    const statement_t *stmt;
+    const var_t *arg;
+
+    current_iface = iface;
+    STATEMENTS_FOR_EACH_FUNC(stmt, type_iface_get_stmts(iface))
+    {
+        const var_t *func = stmt->u.var;
 
-void write_typeformatstring(FILE *file, const statement_list_t *stmts, type_pred_t pred)
+        if (is_local(func->attrs)) continue;
+        fill_type_cache(type_function_get_rettype(func->declspec.type));
+        if (type_function_get_args(func->declspec.type))
+            LIST_FOR_EACH_ENTRY( arg, type_function_get_args(func->declspec.type), const var_t, entry )
+                fill_type_cache(arg->declspec.type);
+    }
+    current_iface = NULL;
+}
+
+static int need_typegen(const type_t *iface)
+{
+    return (do_proxies && need_proxy(iface)) || ((do_client || do_server) && need_stub(iface));
+}
+
+/* Called before write_outputs forks the generators, so that the proxy,
+ * client and server ones find the properties of the types they share
+ * already computed instead of each working them out again. */
+void fill_typegen_cache(const statement_list_t *stmts)
+{
+    for_each_iface(stmts, fill_iface_cache, need_typegen, NULL, 0, NULL);
+}
+
+
+void write_typeformatstring(FILE *file)
 {
     int indent = 0;
 
@@ -3762,8 +4214,7 @@ void write_typeformatstring(FILE *file, const statement_list_t *stmts, type_pred
     indent++;
     print_file(file, indent, "NdrFcShort(0x0),\n");
 
-    set_all_tfswrite(TRUE);
-    process_tfs(file, stmts, pred);
+    write_format_string(file, &type_format);
 
     print_file(file, indent, "0x0\n");
     indent--;
@@ -4575,34 +5026,13 @@ void write_remoting_arguments(FILE *file, int indent, const var_t *func, const c
 unsigned int get_size_procformatstring_func(const type_t *iface, const var_t *func)
 {
     unsigned int offset = 0;
+
+    /* set when the proc format string was built */
+    if (func->procstring_size) return func->procstring_size;
     write_procformatstring_func( NULL, 0, iface, func, &offset, 0 );
     return offset;
 }
 
-static void get_size_procformatstring_iface(type_t *iface, FILE *file, int indent, unsigned int *size)
-{
-    const statement_t *stmt;
-    STATEMENTS_FOR_EACH_FUNC( stmt, type_iface_get_stmts(iface) )
-    {
-        const var_t *func = stmt->u.var;
-        if (!is_local(func->attrs))
-            *size += get_size_procformatstring_func( iface, func );
-    }
-}
-
-unsigned int get_size_procformatstring(const statement_list_t *stmts, type_pred_t pred)
-{
-    unsigned int size = 1;
-    for_each_iface(stmts, get_size_procformatstring_iface, pred, NULL, 0, &size);
-    return size;
-}
-
-unsigned int get_size_typeformatstring(const statement_list_t *stmts, type_pred_t pred)
-{
-    set_all_tfswrite(FALSE);
-    return process_tfs(NULL, stmts, pred);
-}
-
 void declare_stub_args( FILE *file, int indent, const var_t *func )
 {
     int in_attr, out_attr;
@@ -4842,7 +5272,7 @@ void write_func_param_struct( FILE *file, const type_t *iface, const type_t *fun
 
 void write_pointer_checks( FILE *file, int indent, const var_t *func )
 {
-    const var_list_t *args = type_get_function_args( func->type );
+    const var_list_t *args = type_function_get_args( func->declspec.type );
     const var_t *var;
 
     if (!args) return;
@@ -31,6 +31,11 @@
 #endif
 #include <string.h>
 #include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #ifdef __REACTOS__
 #include <typedefs.h>
@@ -47,6 +52,9 @@
 #include "widltypes.h"
 #include "typelib_struct.h"
 #include "typetree.h"
+#include "depfile.h"
+#include "importcache.h"
+#include "timing.h"
 
 #ifdef __REACTOS__
 static typelib_t *typelib;
@@ -255,84 +263,210 @@ void start_typelib(typelib_t *typelib_type)
 
 void end_typelib(void)
 {
-    if (!typelib) return;
+    typelib = NULL;
+}
+
+/* the typelib is written along with the other outputs once the whole file is parsed */
+void write_typelib(const statement_list_t *stmts)
+{
+    const statement_t *stmt;
 
-    create_msft_typelib(typelib);
+    if (!do_typelib || !stmts) return;
+    LIST_FOR_EACH_ENTRY( stmt, stmts, const statement_t, entry )
+    {
+        if (stmt->type != STMT_LIBRARY) continue;
+        if (do_old_typelib)
+            create_sltg_typelib( stmt->u.lib );
+        else
+            create_msft_typelib( stmt->u.lib );
+    }
 }
 #endif
 
-static void tlb_read(int fd, void *buf, int count)
+/* a typelib file mapped in memory, or read into it where mmap is not available */
+struct tlb_file
+{
+    const unsigned char *data;
+    size_t size;
+    int mapped;
+};
+
+/* parsed importlibs, kept for the whole process so that batch and server
+ * mode only read each typelib file once, and in the import cache directory
+ * for later runs */
+struct parsed_importlib
+{
+    struct list entry;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    long long mtime;  /* in nanoseconds */
+    int version;
+    GUID guid;
+    int ntypeinfos;
+    importinfo_t *importinfos;
+    struct symbol_table index;  /* name -> importinfos entry */
+};
+
+static struct list parsed_importlibs = LIST_INIT( parsed_importlibs );
+
+static const void *tlb_ptr(const struct tlb_file *tlb, unsigned int offset, unsigned int size)
 {
-    if(read(fd, buf, count) < count)
+    if(offset > tlb->size || size > tlb->size - offset)
         error("error while reading importlib.\n");
+    return tlb->data + offset;
 }
 
-static void tlb_lseek(int fd, off_t offset)
+static void tlb_read(const struct tlb_file *tlb, unsigned int offset, void *buf, unsigned int size)
 {
-    if(lseek(fd, offset, SEEK_SET) == -1)
-        error("lseek failed\n");
+    /* fields are not necessarily aligned in the file */
+    memcpy(buf, tlb_ptr(tlb, offset, size), size);
 }
 
-static void msft_read_guid(int fd, MSFT_SegDir *segdir, int offset, GUID *guid)
+static void msft_read_guid(const struct tlb_file *tlb, MSFT_SegDir *segdir, int offset, GUID *guid)
 {
-    tlb_lseek(fd, segdir->pGuidTab.offset+offset);
-    tlb_read(fd, guid, sizeof(GUID));
+    tlb_read(tlb, segdir->pGuidTab.offset+offset, guid, sizeof(GUID));
 }
 
-static void read_msft_importlib(importlib_t *importlib, int fd)
+static void read_msft_importlib(struct parsed_importlib *parsed, const struct tlb_file *tlb)
 {
     MSFT_Header header;
     MSFT_SegDir segdir;
-    int *typeinfo_offs;
+    unsigned int typeinfo_base;
+    char name[256];
     int i;
 
-    importlib->allocated = 0;
+    tlb_read(tlb, 0, &header, sizeof(header));
 
-    tlb_lseek(fd, 0);
-    tlb_read(fd, &header, sizeof(header));
+    parsed->version = header.version;
 
-    importlib->version = header.version;
+    if(header.nrtypeinfos < 0)
+        error("error while reading importlib.\n");
+    typeinfo_base = sizeof(header) + header.nrtypeinfos*sizeof(INT);
+    tlb_read(tlb, typeinfo_base, &segdir, sizeof(segdir));
+    typeinfo_base += sizeof(segdir);
 
-    typeinfo_offs = xmalloc(header.nrtypeinfos*sizeof(INT));
-    tlb_read(fd, typeinfo_offs, header.nrtypeinfos*sizeof(INT));
-    tlb_read(fd, &segdir, sizeof(segdir));
+    msft_read_guid(tlb, &segdir, header.posguid, &parsed->guid);
 
-    msft_read_guid(fd, &segdir, header.posguid, &importlib->guid);
+    parsed->ntypeinfos = header.nrtypeinfos;
+    parsed->importinfos = xmalloc(parsed->ntypeinfos*sizeof(importinfo_t));
 
-    importlib->ntypeinfos = header.nrtypeinfos;
-    importlib->importinfos = xmalloc(importlib->ntypeinfos*sizeof(importinfo_t));
-
-    for(i=0; i < importlib->ntypeinfos; i++) {
+    for(i=0; i < parsed->ntypeinfos; i++) {
+        importinfo_t *info = &parsed->importinfos[i];
         MSFT_TypeInfoBase base;
         MSFT_NameIntro nameintro;
+        INT typeinfo_offs;
         int len;
 
-        tlb_lseek(fd, sizeof(MSFT_Header) + header.nrtypeinfos*sizeof(INT) + sizeof(MSFT_SegDir)
-                 + typeinfo_offs[i]);
-        tlb_read(fd, &base, sizeof(base));
+        tlb_read(tlb, sizeof(header) + i*sizeof(INT), &typeinfo_offs, sizeof(typeinfo_offs));
+        tlb_read(tlb, typeinfo_base + typeinfo_offs, &base, sizeof(base));
 
-        importlib->importinfos[i].importlib = importlib;
-        importlib->importinfos[i].flags = (base.typekind&0xf)<<24;
-        importlib->importinfos[i].offset = -1;
-        importlib->importinfos[i].id = i;
+        info->importlib = NULL;
+        info->flags = (base.typekind&0xf)<<24;
+        info->offset = -1;
+        info->id = i;
 
         if(base.posguid != -1) {
-            importlib->importinfos[i].flags |= MSFT_IMPINFO_OFFSET_IS_GUID;
-            msft_read_guid(fd, &segdir, base.posguid, &importlib->importinfos[i].guid);
+            info->flags |= MSFT_IMPINFO_OFFSET_IS_GUID;
+            msft_read_guid(tlb, &segdir, base.posguid, &info->guid);
         }
-        else memset( &importlib->importinfos[i].guid, 0, sizeof(importlib->importinfos[i].guid));
+        else memset( &info->guid, 0, sizeof(info->guid));
 
-        tlb_lseek(fd, segdir.pNametab.offset + base.NameOffset);
-        tlb_read(fd, &nameintro, sizeof(nameintro));
+        tlb_read(tlb, segdir.pNametab.offset + base.NameOffset, &nameintro, sizeof(nameintro));
 
         len = nameintro.namelen & 0xff;
 
-        importlib->importinfos[i].name = xmalloc(len+1);
-        tlb_read(fd, importlib->importinfos[i].name, len);
-        importlib->importinfos[i].name[len] = 0;
+        memcpy(name, tlb_ptr(tlb, segdir.pNametab.offset + base.NameOffset + sizeof(nameintro), len), len);
+        name[len] = 0;
+        info->name = intern_string(name);
+    }
+}
+
+/* The cache entry of an importlib holds its version and GUID, and the
+ * flags, GUID and name of each typeinfo.  It is keyed by the identity of
+ * the file, so a typelib that is rewritten gets a new entry. */
+static char *get_importlib_cache_key(const struct parsed_importlib *parsed)
+{
+    return strmake("importlib %llu %llu %llu %lld", (unsigned long long)parsed->dev,
+                   (unsigned long long)parsed->ino, (unsigned long long)parsed->size, parsed->mtime);
+}
+
+static int load_importlib_cache(struct parsed_importlib *parsed)
+{
+    const unsigned char *data, *ptr, *end;
+    char *key, name[256];
+    size_t size;
+    int i;
+
+    key = get_importlib_cache_key(parsed);
+    data = import_cache_load_data(key, &size);
+    free(key);
+    if(!data) return 0;
+
+    ptr = data;
+    end = data + size;
+    if(size < 2*sizeof(int) + sizeof(GUID)) goto fail;
+    memcpy(&parsed->version, ptr, sizeof(int)); ptr += sizeof(int);
+    memcpy(&parsed->guid, ptr, sizeof(GUID)); ptr += sizeof(GUID);
+    memcpy(&parsed->ntypeinfos, ptr, sizeof(int)); ptr += sizeof(int);
+    if(parsed->ntypeinfos < 0 || parsed->ntypeinfos > (end - ptr) / (sizeof(int) + sizeof(GUID) + 1)) goto fail;
+
+    parsed->importinfos = xmalloc(parsed->ntypeinfos*sizeof(importinfo_t));
+    for(i=0; i < parsed->ntypeinfos; i++) {
+        importinfo_t *info = &parsed->importinfos[i];
+        int len;
+
+        if(end - ptr < sizeof(int) + sizeof(GUID) + 1) goto fail;
+        memcpy(&info->flags, ptr, sizeof(int)); ptr += sizeof(int);
+        memcpy(&info->guid, ptr, sizeof(GUID)); ptr += sizeof(GUID);
+        len = *ptr++;
+        if(end - ptr < len) goto fail;
+        memcpy(name, ptr, len);
+        name[len] = 0;
+        ptr += len;
+
+        info->importlib = NULL;
+        info->offset = -1;
+        info->id = i;
+        info->name = intern_string(name);
     }
+    if(ptr != end) goto fail;
+    free((void *)data);
+    return 1;
+
+fail:
+    free(parsed->importinfos);
+    parsed->importinfos = NULL;
+    free((void *)data);
+    return 0;
+}
 
-    free(typeinfo_offs);
+static void store_importlib_cache(const struct parsed_importlib *parsed)
+{
+    unsigned char *data, *ptr;
+    char *key;
+    int i;
+
+    if(!import_cache_dir) return;
+    data = ptr = xmalloc(2*sizeof(int) + sizeof(GUID) + parsed->ntypeinfos*(sizeof(int) + sizeof(GUID) + 256));
+    memcpy(ptr, &parsed->version, sizeof(int)); ptr += sizeof(int);
+    memcpy(ptr, &parsed->guid, sizeof(GUID)); ptr += sizeof(GUID);
+    memcpy(ptr, &parsed->ntypeinfos, sizeof(int)); ptr += sizeof(int);
+    for(i=0; i < parsed->ntypeinfos; i++) {
+        const importinfo_t *info = &parsed->importinfos[i];
+        size_t len = strlen(info->name);
+
+        memcpy(ptr, &info->flags, sizeof(int)); ptr += sizeof(int);
+        memcpy(ptr, &info->guid, sizeof(GUID)); ptr += sizeof(GUID);
+        *ptr++ = len;
+        memcpy(ptr, info->name, len);
+        ptr += len;
+    }
+
+    key = get_importlib_cache_key(parsed);
+    import_cache_store_data(key, data, ptr - data);
+    free(key);
+    free(data);
 }
 
 static int open_typelib(const char *name)
@@ -342,27 +476,87 @@ static int open_typelib(const char *name)
 
     file_name = wpp_find_include(name, NULL);
     if(!file_name)
-        return open(name, O_RDONLY | O_BINARY );
+    {
+        fd = open(name, O_RDONLY | O_BINARY );
+        if (fd != -1) add_dependency(name);
+        return fd;
+    }
 
     fd = open(file_name, O_RDONLY | O_BINARY );
+    if (fd != -1) add_dependency(file_name);
     free(file_name);
     return fd;
 }
 
-static void read_importlib(importlib_t *importlib)
+static void map_typelib(struct tlb_file *tlb, int fd, const struct stat *st)
 {
-    int fd;
+    unsigned char *data;
+    size_t pos;
+    int ret;
+
+    tlb->size = st->st_size;
+    tlb->mapped = 0;
+#ifndef _WIN32
+    if(tlb->size)
+    {
+        void *ptr = mmap(NULL, tlb->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(ptr != MAP_FAILED)
+        {
+            tlb->data = ptr;
+            tlb->mapped = 1;
+            return;
+        }
+    }
+#endif
+    data = xmalloc(tlb->size + 1);
+    for(pos = 0; pos < tlb->size; pos += ret)
+        if((ret = read(fd, data + pos, tlb->size - pos)) <= 0)
+            error("error while reading importlib.\n");
+    tlb->data = data;
+}
+
+static void unmap_typelib(struct tlb_file *tlb)
+{
+#ifndef _WIN32
+    if(tlb->mapped)
+    {
+        munmap((void *)tlb->data, tlb->size);
+        return;
+    }
+#endif
+    free((void *)tlb->data);
+}
+
+/* the modification time of a file in nanoseconds, where the system has them */
+static long long get_mtime(const struct stat *st)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    return st->st_mtime * 1000000000ll + st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return st->st_mtime * 1000000000ll + st->st_mtimespec.tv_nsec;
+#else
+    return st->st_mtime * 1000000000ll;
+#endif
+}
+
+static struct parsed_importlib *parse_importlib(const char *name)
+{
+    struct parsed_importlib *parsed;
+    struct tlb_file tlb;
+    struct stat st;
+    long long mtime;
     INT magic;
+    int fd, i;
 
-    fd = open_typelib(importlib->name);
+    fd = open_typelib(name);
 
     /* widl extension: if importlib name has no .tlb extension, try using .tlb */
     if(fd < 0) {
-        const char *p = strrchr(importlib->name, '.');
-        size_t len = p ? p - importlib->name : strlen(importlib->name);
-        if(strcmp(importlib->name + len, ".tlb")) {
+        const char *p = strrchr(name, '.');
+        size_t len = p ? p - name : strlen(name);
+        if(strcmp(name + len, ".tlb")) {
             char *tlb_name = xmalloc(len + 5);
-            memcpy(tlb_name, importlib->name, len);
+            memcpy(tlb_name, name, len);
             strcpy(tlb_name + len, ".tlb");
             fd = open_typelib(tlb_name);
             free(tlb_name);
@@ -370,19 +564,117 @@ static void read_importlib(importlib_t *importlib)
     }
 
     if(fd < 0)
-        error("Could not find importlib %s.\n", importlib->name);
+        error("Could not find importlib %s.\n", name);
 
-    tlb_read(fd, &magic, sizeof(magic));
+    if(fstat(fd, &st) == -1)
+        error("error while reading importlib.\n");
+    mtime = get_mtime(&st);
 
-    switch(magic) {
-    case MSFT_MAGIC:
-        read_msft_importlib(importlib, fd);
-        break;
-    default:
-        error("Wrong or unsupported typelib magic %x\n", magic);
-    };
+    LIST_FOR_EACH_ENTRY( parsed, &parsed_importlibs, struct parsed_importlib, entry )
+    {
+        if(parsed->dev == st.st_dev && parsed->ino == st.st_ino &&
+           parsed->size == st.st_size && parsed->mtime == mtime)
+        {
+            chat("Using parsed importlib %s\n", name);
+            close(fd);
+            return parsed;
+        }
+    }
+
+    parsed = xmalloc(sizeof(*parsed));
+    memset(parsed, 0, sizeof(*parsed));
+    parsed->dev = st.st_dev;
+    parsed->ino = st.st_ino;
+    parsed->size = st.st_size;
+    parsed->mtime = mtime;
+
+    if(load_importlib_cache(parsed))
+    {
+        chat("Using cached importlib %s\n", name);
+        close(fd);
+    }
+    else
+    {
+        map_typelib(&tlb, fd, &st);
+        close(fd);
+
+        tlb_read(&tlb, 0, &magic, sizeof(magic));
+
+        switch(magic) {
+        case MSFT_MAGIC:
+            read_msft_importlib(parsed, &tlb);
+            break;
+        default:
+            error("Wrong or unsupported typelib magic %x\n", magic);
+        };
+
+        unmap_typelib(&tlb);
+        store_importlib_cache(parsed);
+    }
+
+    /* the first typeinfo of a given name wins, as with the old linear search */
+    for(i=0; i < parsed->ntypeinfos; i++) {
+        importinfo_t *info = &parsed->importinfos[i];
+        void **slot = symbol_table_add(&parsed->index, info->name);
+        if(!*slot) *slot = info;
+    }
+
+    list_add_tail(&parsed_importlibs, &parsed->entry);
+    return parsed;
+}
+
+/* read an importlib ahead of the inputs that use it, the compile server
+ * does so for the importlibs it is given */
+void preload_importlib(const char *name)
+{
+    parse_importlib(name);
+}
+
+static void read_importlib(importlib_t *importlib)
+{
+    struct parsed_importlib *parsed = parse_importlib(importlib->name);
+    int i;
+
+    /* the offsets are allocated in the typelib being written, so each
+     * importlib gets its own copy of the importinfos */
+    importlib->allocated = 0;
+    importlib->version = parsed->version;
+    importlib->guid = parsed->guid;
+    importlib->ntypeinfos = parsed->ntypeinfos;
+    importlib->importinfos = xmalloc(importlib->ntypeinfos*sizeof(importinfo_t));
+    memcpy(importlib->importinfos, parsed->importinfos, importlib->ntypeinfos*sizeof(importinfo_t));
+    for(i=0; i < importlib->ntypeinfos; i++)
+        importlib->importinfos[i].importlib = importlib;
+    importlib->index = &parsed->index;
+}
+
+static void index_importlib(typelib_t *typelib, importlib_t *importlib)
+{
+    int i;
+
+    /* the last importlib added wins, and within an importlib the first
+     * typeinfo of a given name, as they used to be searched in that order */
+    for(i=0; i < importlib->ntypeinfos; i++) {
+        importinfo_t *info = &importlib->importinfos[i];
+        const importinfo_t *first = symbol_table_find(importlib->index, info->name);
+
+        if(first->id == i)
+            *symbol_table_add(&typelib->importinfos, info->name) = info;
+    }
+}
+
+/* look up a type by name in all the importlibs of a typelib */
+importinfo_t *find_importinfo(typelib_t *typelib, const char *name)
+{
+    importinfo_t *info;
+
+    chat("search importlib %s\n", name);
+
+    if(!name || !(info = symbol_table_find(&typelib->importinfos, name)))
+        return NULL;
 
-    close(fd);
+    chat("Found %s in importlib %s.\n", name, info->importlib->name);
+    return info;
 }
 
 #ifdef __REACTOS__
@@ -405,6 +697,9 @@ void add_importlib(const char *name, typelib_t *typelib)
     memset( importlib, 0, sizeof(*importlib) );
     importlib->name = xstrdup(name);
 
+    time_phase_start("importlib", name);
     read_importlib(importlib);
+    time_phase_end();
     list_add_head( &typelib->importlibs, &importlib->entry );
+    index_importlib(typelib, importlib);
 }
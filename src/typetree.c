@@ -29,6 +29,7 @@
 #include "parser.h"
 #include "typetree.h"
 #include "header.h"
+#include "arena.h"
 
 type_t *duptype(type_t *t, int dupname)
 {
@@ -138,8 +139,8 @@ type_t *type_new_function(var_list_t *args)
         if (list_count(args) == 1 && !arg->name && arg->declspec.type && type_get_type(arg->declspec.type) == TYPE_VOID)
         {
             list_remove(&arg->entry);
-            free(arg);
-            free(args);
+            node_free(NODE_VAR, arg, sizeof(*arg));
+            node_free(NODE_LIST, args, sizeof(*args));
             args = NULL;
         }
     }
@@ -170,9 +171,9 @@ type_t *type_new_function(var_list_t *args)
     }
 
     t = make_type(TYPE_FUNCTION);
-    t->details.function = xmalloc(sizeof(*t->details.function));
+    t->details.function = node_alloc(NODE_TYPE_DETAILS, sizeof(*t->details.function));
     t->details.function->args = args;
-    t->details.function->retval = make_var(xstrdup("_RetVal"));
+    t->details.function->retval = make_var(intern_string("_RetVal"));
     return t;
 }
 
@@ -249,8 +250,12 @@ type_t *type_new_int(enum type_basic_type basic_type, int sign)
     /* map sign { -1, 0, 1 } -> { 0, 1, 2 } */
     if (!int_types[basic_type][sign + 1])
     {
+        /* shared between input files, so it must outlive the current one */
+        struct arena *arena = set_node_arena(import_arena);
+
         int_types[basic_type][sign + 1] = type_new_basic(basic_type);
         int_types[basic_type][sign + 1]->details.basic.sign = sign;
+        set_node_arena(arena);
     }
     return int_types[basic_type][sign + 1];
 }
@@ -259,7 +264,12 @@ type_t *type_new_void(void)
 {
     static type_t *void_type = NULL;
     if (!void_type)
+    {
+        struct arena *arena = set_node_arena(import_arena);
+
         void_type = make_type(TYPE_VOID);
+        set_node_arena(arena);
+    }
     return void_type;
 }
 
@@ -281,7 +291,8 @@ type_t *type_new_enum(const char *name, struct namespace *namespace, int defined
 
     if (!t->defined && defined)
     {
-        t->details.enumeration = xmalloc(sizeof(*t->details.enumeration));
+        extend_type(t);
+        t->details.enumeration = node_alloc(NODE_TYPE_DETAILS, sizeof(*t->details.enumeration));
         t->details.enumeration->enums = enums;
         t->defined = TRUE;
     }
@@ -309,7 +320,8 @@ type_t *type_new_struct(char *name, struct namespace *namespace, int defined, va
 
     if (!t->defined && defined)
     {
-        t->details.structure = xmalloc(sizeof(*t->details.structure));
+        extend_type(t);
+        t->details.structure = node_alloc(NODE_TYPE_DETAILS, sizeof(*t->details.structure));
         t->details.structure->fields = fields;
         t->defined = TRUE;
     }
@@ -336,7 +348,8 @@ type_t *type_new_nonencapsulated_union(const char *name, int defined, var_list_t
 
     if (!t->defined && defined)
     {
-        t->details.structure = xmalloc(sizeof(*t->details.structure));
+        extend_type(t);
+        t->details.structure = node_alloc(NODE_TYPE_DETAILS, sizeof(*t->details.structure));
         t->details.structure->fields = fields;
         t->defined = TRUE;
     }
@@ -360,15 +373,16 @@ type_t *type_new_encapsulated_union(char *name, var_t *switch_field, var_t *unio
         if (name)
             reg_type(t, name, NULL, tsUNION);
     }
+    extend_type(t);
     t->type_type = TYPE_ENCAPSULATED_UNION;
 
     if (!t->defined)
     {
         if (!union_field)
-            union_field = make_var(xstrdup("tagged_union"));
+            union_field = make_var(intern_string("tagged_union"));
         union_field->declspec.type = type_new_nonencapsulated_union(gen_name(), TRUE, cases);
 
-        t->details.structure = xmalloc(sizeof(*t->details.structure));
+        t->details.structure = node_alloc(NODE_TYPE_DETAILS, sizeof(*t->details.structure));
         t->details.structure->fields = append_var(NULL, switch_field);
         t->details.structure->fields = append_var(t->details.structure->fields, union_field);
         t->defined = TRUE;
@@ -455,7 +469,8 @@ static unsigned int compute_method_indexes(type_t *iface)
 
 void type_interface_define(type_t *iface, type_t *inherit, statement_list_t *stmts)
 {
-    iface->details.iface = xmalloc(sizeof(*iface->details.iface));
+    extend_type(iface);
+    iface->details.iface = node_alloc(NODE_TYPE_DETAILS, sizeof(*iface->details.iface));
     iface->details.iface->disp_props = NULL;
     iface->details.iface->disp_methods = NULL;
     iface->details.iface->stmts = stmts;
@@ -468,7 +483,8 @@ void type_interface_define(type_t *iface, type_t *inherit, statement_list_t *stm
 
 void type_dispinterface_define(type_t *iface, var_list_t *props, var_list_t *methods)
 {
-    iface->details.iface = xmalloc(sizeof(*iface->details.iface));
+    extend_type(iface);
+    iface->details.iface = node_alloc(NODE_TYPE_DETAILS, sizeof(*iface->details.iface));
     iface->details.iface->disp_props = props;
     iface->details.iface->disp_methods = methods;
     iface->details.iface->stmts = NULL;
@@ -482,7 +498,8 @@ void type_dispinterface_define(type_t *iface, var_list_t *props, var_list_t *met
 
 void type_dispinterface_define_from_iface(type_t *dispiface, type_t *iface)
 {
-    dispiface->details.iface = xmalloc(sizeof(*dispiface->details.iface));
+    extend_type(dispiface);
+    dispiface->details.iface = node_alloc(NODE_TYPE_DETAILS, sizeof(*dispiface->details.iface));
     dispiface->details.iface->disp_props = NULL;
     dispiface->details.iface->disp_methods = NULL;
     dispiface->details.iface->stmts = NULL;
@@ -497,13 +514,15 @@ void type_dispinterface_define_from_iface(type_t *dispiface, type_t *iface)
 void type_module_define(type_t *module, statement_list_t *stmts)
 {
     if (module->details.module) error_loc("multiple definition error\n");
-    module->details.module = xmalloc(sizeof(*module->details.module));
+    extend_type(module);
+    module->details.module = node_alloc(NODE_TYPE_DETAILS, sizeof(*module->details.module));
     module->details.module->stmts = stmts;
     module->defined = TRUE;
 }
 
 type_t *type_coclass_define(type_t *coclass, ifref_list_t *ifaces)
 {
+    extend_type(coclass);
     coclass->details.coclass.ifaces = ifaces;
     coclass->defined = TRUE;
     return coclass;
@@ -28,13 +28,16 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #include "widl.h"
 #include "utils.h"
 #include "parser.h"
 
-#define CURRENT_LOCATION { input_name ? input_name : "stdin", line_number, parser_text }
-
 static const int want_near_indication = 0;
 
 static void make_print(char *str)
@@ -68,20 +71,15 @@ static void generic_msg(const loc_info_t *loc_info, const char *s, const char *t
 
 void error_loc(const char *s, ...)
 {
-	loc_info_t cur_loc = CURRENT_LOCATION;
+	loc_info_t cur_loc;
 	va_list ap;
+	init_loc_info(&cur_loc);
 	va_start(ap, s);
 	generic_msg(&cur_loc, s, "error", ap);
 	va_end(ap);
 	exit(1);
 }
 
-/* yyerror:  yacc assumes this is not newline terminated.  */
-void parser_error(const char *s)
-{
-	error_loc("%s\n", s);
-}
-
 void error_loc_info(const loc_info_t *loc_info, const char *s, ...)
 {
 	va_list ap;
@@ -93,8 +91,9 @@ void error_loc_info(const loc_info_t *loc_info, const char *s, ...)
 
 int parser_warning(const char *s, ...)
 {
-	loc_info_t cur_loc = CURRENT_LOCATION;
+	loc_info_t cur_loc;
 	va_list ap;
+	init_loc_info(&cur_loc);
 	va_start(ap, s);
 	generic_msg(&cur_loc, s, "warning", ap);
 	va_end(ap);
@@ -198,6 +197,31 @@ size_t widl_getline(char **linep, size_t *lenp, FILE *fp)
     return n;
 }
 
+/* read the rest of a file into memory, followed by two null bytes */
+char *read_file_data(FILE *fp, size_t *size)
+{
+    size_t len = 0, alloc = 8192, n;
+    char *data = xmalloc(alloc);
+
+    while ((n = fread(data + len, 1, alloc - len - 2, fp)))
+    {
+        len += n;
+        if (alloc - len - 2 == 0)
+        {
+            alloc *= 2;
+            data = xrealloc(data, alloc);
+        }
+    }
+    if (ferror(fp))
+    {
+        free(data);
+        return NULL;
+    }
+    data[len] = data[len + 1] = 0;
+    *size = len;
+    return data;
+}
+
 void *xmalloc(size_t size)
 {
     void *res;
@@ -295,13 +319,94 @@ void init_output_buffer(void)
     output_buffer = xmalloc( output_buffer_size );
 }
 
-void flush_output_buffer( const char *name )
+/* make room up front for writers that know how much they are going to output */
+void reserve_output_buffer( size_t size )
+{
+    check_output_buffer_space( size + 1 );
+}
+
+static char *temp_output_name;
+
+static int is_output_unchanged( const char *name, const void *data, size_t size )
+{
+    struct stat st;
+    size_t old_size;
+    char *old;
+    FILE *f;
+    int ret;
+
+    if (stat( name, &st ) || st.st_size != size) return 0;
+    if (!(f = fopen( name, "rb" ))) return 0;
+    old = read_file_data( f, &old_size );
+    fclose( f );
+    ret = old && old_size == size && !memcmp( old, data, size );
+    free( old );
+    return ret;
+}
+
+/* Outputs are only written when their contents change, so that whatever
+ * depends on them is not rebuilt needlessly.  They are written to a
+ * temporary file first and renamed, so that an interrupted run never
+ * leaves a truncated output behind. */
+static void write_output_data( const char *name, const void *data, size_t size )
 {
-    int fd = open( name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666 );
+    int fd;
+
+    if (is_output_unchanged( name, data, size ))
+    {
+        chat( "%s is unchanged\n", name );
+        return;
+    }
+
+    temp_output_name = strmake( "%s.%u.tmp", name, (unsigned int)getpid() );
+    fd = open( temp_output_name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666 );
     if (fd == -1) error( "Error creating %s\n", name );
-    if (write( fd, output_buffer, output_buffer_pos ) != output_buffer_pos)
+    if (write( fd, data, size ) != size)
         error( "Error writing to %s\n", name );
-    close( fd );
+    if (close( fd )) error( "Error writing to %s\n", name );
+#ifdef _WIN32
+    unlink( name );
+#endif
+    if (rename( temp_output_name, name )) error( "Error creating %s\n", name );
+    free( temp_output_name );
+    temp_output_name = NULL;
+}
+
+/* Text outputs used to be written with fopen( name, "w" ), so they have to
+ * keep the CRLF line endings of text mode on Windows. */
+static void write_output_text( const char *name, const char *data, size_t size )
+{
+#ifdef _WIN32
+    char *text = xmalloc( 2 * size + 1 ), *p = text;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (data[i] == '\n') *p++ = '\r';
+        *p++ = data[i];
+    }
+    write_output_data( name, text, p - text );
+    free( text );
+#else
+    write_output_data( name, data, size );
+#endif
+}
+
+/* remove the temporary file of an output that failed to be written */
+void remove_temp_output(void)
+{
+    if (temp_output_name) unlink( temp_output_name );
+}
+
+void flush_output_buffer( const char *name )
+{
+    write_output_data( name, output_buffer, output_buffer_pos );
+    free( output_buffer );
+}
+
+void flush_text_output_buffer( const char *name )
+{
+    write_output_text( name, (const char *)output_buffer, output_buffer_pos );
     free( output_buffer );
 }
 
@@ -359,7 +464,6 @@ void add_output_to_resources( const char *type, const char *name )
 
 void flush_output_resources( const char *name )
 {
-    int fd;
     unsigned int i;
 
     /* all output must have been saved with add_output_to_resources() first */
@@ -377,18 +481,13 @@ void flush_output_resources( const char *name )
     put_dword( 0 );      /* Version */
     put_dword( 0 );      /* Characteristics */
 
-    fd = open( name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666 );
-    if (fd == -1) error( "Error creating %s\n", name );
-    if (write( fd, output_buffer, output_buffer_pos ) != output_buffer_pos)
-        error( "Error writing to %s\n", name );
     for (i = 0; i < nb_resources; i++)
     {
-        if (write( fd, resources[i].data, resources[i].size ) != resources[i].size)
-            error( "Error writing to %s\n", name );
+        put_data( resources[i].data, resources[i].size );
         free( resources[i].data );
     }
-    close( fd );
     nb_resources = 0;
+    write_output_data( name, output_buffer, output_buffer_pos );
     free( output_buffer );
 }
 
@@ -474,3 +573,238 @@ void align_output( unsigned int align )
     memset( output_buffer + output_buffer_pos, 0, size );
     output_buffer_pos += size;
 }
+
+/*******************************************************************
+ *         text output
+ *
+ * The generated source files are written to memory streams and stored
+ * with a single write once complete, unless they did not change.  Most of the text goes through
+ * output_vprintf(), which formats the few conversions used by the
+ * generators itself instead of going through vfprintf.
+ */
+
+struct output_file
+{
+    FILE       *file;
+    char       *name;
+    char       *data;
+    size_t      size;
+    struct list entry;
+};
+
+static struct list output_files = LIST_INIT( output_files );
+
+FILE *open_output_file( const char *name )
+{
+    struct output_file *out = xmalloc( sizeof(*out) );
+
+    out->name = xstrdup( name );
+    out->data = NULL;
+    out->size = 0;
+#ifndef _WIN32
+    out->file = open_memstream( &out->data, &out->size );
+#else
+    if ((out->file = tmpfile())) setvbuf( out->file, NULL, _IOFBF, 1 << 16 );
+#endif
+    if (!out->file) error( "Could not open %s for output\n", name );
+    list_add_tail( &output_files, &out->entry );
+    return out->file;
+}
+
+void close_output_file( FILE *file )
+{
+    struct output_file *out;
+
+    LIST_FOR_EACH_ENTRY( out, &output_files, struct output_file, entry )
+    {
+        if (out->file != file) continue;
+        list_remove( &out->entry );
+#ifdef _WIN32
+        rewind( file );
+        if (!(out->data = read_file_data( file, &out->size )))
+            error( "Error writing to %s\n", out->name );
+#endif
+        if (fclose( file )) error( "Error writing to %s\n", out->name );
+        write_output_text( out->name, out->data, out->size );
+        free( out->data );
+        free( out->name );
+        free( out );
+        return;
+    }
+    assert( 0 );
+}
+
+void output_indent( FILE *file, int indent )
+{
+    static const char spaces[] = "                                                                ";
+
+    for (indent *= 4; indent > 0; indent -= sizeof(spaces) - 1)
+        fwrite( spaces, 1, min( indent, sizeof(spaces) - 1 ), file );
+}
+
+struct text_buffer
+{
+    FILE  *file;
+    size_t pos;
+    char   data[1024];
+};
+
+static void text_flush( struct text_buffer *buf )
+{
+    fwrite( buf->data, 1, buf->pos, buf->file );
+    buf->pos = 0;
+}
+
+static void text_put( struct text_buffer *buf, const char *str, size_t len )
+{
+    if (buf->pos + len > sizeof(buf->data))
+    {
+        text_flush( buf );
+        if (len > sizeof(buf->data))
+        {
+            fwrite( str, 1, len, buf->file );
+            return;
+        }
+    }
+    memcpy( buf->data + buf->pos, str, len );
+    buf->pos += len;
+}
+
+static void text_pad( struct text_buffer *buf, char ch, int count )
+{
+    while (count-- > 0) text_put( buf, &ch, 1 );
+}
+
+static void text_field( struct text_buffer *buf, const char *str, size_t len, int width, int left )
+{
+    if (!left) text_pad( buf, ' ', width - (int)len );
+    text_put( buf, str, len );
+    if (left) text_pad( buf, ' ', width - (int)len );
+}
+
+static void text_number( struct text_buffer *buf, unsigned long long val, int neg, unsigned int base,
+                         int width, int zero, int left )
+{
+    static const char digits[] = "0123456789abcdef";
+    char tmp[24], *end = tmp + sizeof(tmp), *p = end;
+
+    do *--p = digits[val % base]; while (val /= base);
+    if (zero && !left)
+    {
+        if (neg) text_put( buf, "-", 1 );
+        text_pad( buf, '0', width - neg - (int)(end - p) );
+        text_put( buf, p, end - p );
+        return;
+    }
+    if (neg) *--p = '-';
+    text_field( buf, p, end - p, width, left );
+}
+
+/* check that all conversions in the format are handled by output_vprintf */
+static int is_simple_format( const char *format )
+{
+    const char *p = format;
+
+    while ((p = strchr( p, '%' )))
+    {
+        if (*++p == '%')
+        {
+            p++;
+            continue;
+        }
+        while (*p == '0' || *p == '-') p++;
+        while (isdigit( (unsigned char)*p )) p++;
+        if (*p == 'h' || *p == 'l')
+        {
+            if (p[1] == p[0]) p++;
+            p++;
+        }
+        if (!*p || !strchr( "cdsux", *p )) return 0;
+        p++;
+    }
+    return 1;
+}
+
+void output_vprintf( FILE *file, const char *format, va_list args )
+{
+    struct text_buffer buf;
+    const char *p, *start;
+
+    if (!is_simple_format( format ))
+    {
+        vfprintf( file, format, args );
+        return;
+    }
+
+    buf.file = file;
+    buf.pos = 0;
+    for (p = format; *p; )
+    {
+        unsigned long long val;
+        int zero = 0, left = 0, width = 0, size = 0, neg = 0;
+
+        for (start = p; *p && *p != '%'; p++) ;
+        text_put( &buf, start, p - start );
+        if (!*p++) break;
+
+        if (*p == '%')
+        {
+            text_put( &buf, p++, 1 );
+            continue;
+        }
+        for (;; p++)
+        {
+            if (*p == '0') zero = 1;
+            else if (*p == '-') left = 1;
+            else break;
+        }
+        while (isdigit( (unsigned char)*p )) width = width * 10 + *p++ - '0';
+        if (*p == 'h') size = (*++p == 'h') ? (p++, -2) : -1;
+        else if (*p == 'l') size = (*++p == 'l') ? (p++, 2) : 1;
+
+        switch (*p++)
+        {
+        case 'c':
+        {
+            char ch = va_arg( args, int );
+            text_field( &buf, &ch, 1, width, left );
+            continue;
+        }
+        case 's':
+        {
+            const char *str = va_arg( args, const char * );
+            if (!str) str = "(null)";
+            text_field( &buf, str, strlen( str ), width, left );
+            continue;
+        }
+        case 'd':
+        {
+            long long sval;
+            switch (size)
+            {
+            case -2: sval = (signed char)va_arg( args, int ); break;
+            case -1: sval = (short)va_arg( args, int ); break;
+            case 1:  sval = va_arg( args, long ); break;
+            case 2:  sval = va_arg( args, long long ); break;
+            default: sval = va_arg( args, int ); break;
+            }
+            neg = sval < 0;
+            val = neg ? -(unsigned long long)sval : sval;
+            text_number( &buf, val, neg, 10, width, zero, left );
+            continue;
+        }
+        default:  /* 'u' or 'x' */
+            switch (size)
+            {
+            case -2: val = (unsigned char)va_arg( args, unsigned int ); break;
+            case -1: val = (unsigned short)va_arg( args, unsigned int ); break;
+            case 1:  val = va_arg( args, unsigned long ); break;
+            case 2:  val = va_arg( args, unsigned long long ); break;
+            default: val = va_arg( args, unsigned int ); break;
+            }
+            text_number( &buf, val, 0, p[-1] == 'x' ? 16 : 10, width, zero, left );
+            continue;
+        }
+    }
+    text_flush( &buf );
+}
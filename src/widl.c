@@ -34,6 +34,10 @@
 #include <assert.h>
 #include <ctype.h>
 #include <signal.h>
+#ifndef _WIN32
+# include <sys/resource.h>
+# include <sys/wait.h>
+#endif
 #ifdef HAVE_GETOPT_H
 # include <getopt.h>
 #endif
@@ -43,14 +47,23 @@
 #include "parser.h"
 #include "wine/wpp.h"
 #include "header.h"
+#include "typelib.h"
+#include "typegen.h"
+#include "importcache.h"
+#include "compile_server.h"
 #include "pathtools.h"
+#include "depfile.h"
+#include "timing.h"
 
 static const char usage[] =
 "Usage: widl [options...] infile.idl\n"
 "   or: widl [options...] --dlldata-only name1 [name2...]\n"
+"   or: widl [options...] --batch=file\n"
+"   or: widl [options...] --server=socket [import1.idl|lib1.tlb...]\n"
 "   --acf=file         Use ACF file\n"
 "   -app_config        Ignored, present for midl compatibility\n"
 "   -b arch            Set the target architecture\n"
+"   --batch=file       Compile all input files listed in file\n"
 "   -c                 Generate client stub\n"
 "   -d n               Set debug level to 'n'\n"
 "   -D id[=val]        Define preprocessor identifier id=val\n"
@@ -59,8 +72,11 @@ static const char usage[] =
 "   -h                 Generate headers\n"
 "   -H file            Name of header file (default is infile.h)\n"
 "   -I path            Set include search dir to path (multiple -I allowed)\n"
+"   --import-cache=dir Cache preprocessed imports and parsed importlibs in dir\n"
 "   --local-stubs=file Write empty stubs for call_as/local methods to file\n"
 "   -m32, -m64         Set the target architecture (Win32 or Win64)\n"
+"   -MD                Write a make dependency file (default is infile.d)\n"
+"   -MF file           Name of the dependency file\n"
 "   -N                 Do not preprocess input\n"
 "   --nostdinc         Do not search the standard include path\n"
 "   --ns_prefix        Prefix namespaces with ABI namespace\n"
@@ -76,7 +92,10 @@ static const char usage[] =
 "   -robust            Ignored, present for midl compatibility\n"
 "   --sysroot=DIR      Prefix include paths with DIR\n"
 "   -s                 Generate server stub\n"
+"   --stats            Print parse tree and memory statistics\n"
+"   --server=socket    Serve compile requests on a Unix socket\n"
 "   -t                 Generate typelib\n"
+"   --time-report[=f]  Report the time of each phase, f is 'text' or 'json'\n"
 "   -u                 Generate interface identifiers file\n"
 "   -V                 Print version and exit\n"
 "   -W                 Enable pedantic warnings\n"
@@ -112,7 +131,7 @@ enum target_cpu target_cpu = CPU_ARM64;
 #endif
 
 int debuglevel = DEBUGLEVEL_NONE;
-int parser_debug, yy_flex_debug;
+int parser_debug;
 
 int pedantic = 0;
 int do_everything = 1;
@@ -126,6 +145,8 @@ int do_server = 0;
 int do_regscript = 0;
 int do_idfile = 0;
 int do_dlldata = 0;
+int do_depfile = 0;
+int do_stats = 0;
 static int no_preprocess = 0;
 int old_names = 0;
 int win32_packing = 8;
@@ -151,14 +172,16 @@ char *server_name;
 char *server_token;
 char *regscript_name;
 char *regscript_token;
-static char *idfile_name;
-char *temp_name;
+char *idfile_name;
+char *depfile_name;
+static char *output_name;
+static char *batch_name;
+static char *server_socket;
+static char *server_key;
 const char *prefix_client = "";
 const char *prefix_server = "";
 static const char *includedir;
 
-int line_number = 1;
-
 static FILE *idfile;
 
 unsigned int pointer_size = 0;
@@ -169,8 +192,12 @@ enum {
     OLDNAMES_OPTION = CHAR_MAX + 1,
     ACF_OPTION,
     APP_CONFIG_OPTION,
+    BATCH_OPTION,
     DLLDATA_OPTION,
     DLLDATA_ONLY_OPTION,
+    DEPFILE_OPTION,
+    DEPFILE_NAME_OPTION,
+    IMPORT_CACHE_OPTION,
     LOCAL_STUBS_OPTION,
     NOSTDINC_OPTION,
     OLD_TYPELIB_OPTION,
@@ -181,7 +208,10 @@ enum {
     RT_NS_PREFIX,
     RT_OPTION,
     ROBUST_OPTION,
+    SERVER_OPTION,
+    STATS_OPTION,
     SYSROOT_OPTION,
+    TIME_REPORT_OPTION,
     WIN32_OPTION,
     WIN64_OPTION,
     WIN32_ALIGN_OPTION,
@@ -193,10 +223,14 @@ static const char short_options[] =
 static const struct option long_options[] = {
     { "acf", 1, NULL, ACF_OPTION },
     { "app_config", 0, NULL, APP_CONFIG_OPTION },
+    { "batch", 1, NULL, BATCH_OPTION },
     { "dlldata", 1, NULL, DLLDATA_OPTION },
     { "dlldata-only", 0, NULL, DLLDATA_ONLY_OPTION },
     { "help", 0, NULL, PRINT_HELP },
+    { "import-cache", 1, NULL, IMPORT_CACHE_OPTION },
     { "local-stubs", 1, NULL, LOCAL_STUBS_OPTION },
+    { "MD", 0, NULL, DEPFILE_OPTION },
+    { "MF", 1, NULL, DEPFILE_NAME_OPTION },
     { "nostdinc", 0, NULL, NOSTDINC_OPTION },
     { "ns_prefix", 0, NULL, RT_NS_PREFIX },
     { "oldnames", 0, NULL, OLDNAMES_OPTION },
@@ -206,8 +240,11 @@ static const struct option long_options[] = {
     { "prefix-client", 1, NULL, PREFIX_CLIENT_OPTION },
     { "prefix-server", 1, NULL, PREFIX_SERVER_OPTION },
     { "robust", 0, NULL, ROBUST_OPTION },
+    { "server", 1, NULL, SERVER_OPTION },
+    { "stats", 0, NULL, STATS_OPTION },
     { "sysroot", 1, NULL, SYSROOT_OPTION },
     { "target", 0, NULL, 'b' },
+    { "time-report", 2, NULL, TIME_REPORT_OPTION },
     { "winrt", 0, NULL, RT_OPTION },
     { "win32", 0, NULL, WIN32_OPTION },
     { "win64", 0, NULL, WIN64_OPTION },
@@ -390,9 +427,7 @@ static void write_dlldata_list(struct list *filenames, int define_proxy_delegati
   FILE *dlldata;
   filename_node_t *node;
 
-  dlldata = fopen(dlldata_name, "w");
-  if (!dlldata)
-    error("couldn't open %s: %s\n", dlldata_name, strerror(errno));
+  dlldata = open_output_file(dlldata_name);
 
   fprintf(dlldata, "/*** Autogenerated by WIDL %s ", PACKAGE_VERSION);
   fprintf(dlldata, "- Do not edit ***/\n\n");
@@ -420,7 +455,7 @@ static void write_dlldata_list(struct list *filenames, int define_proxy_delegati
 
   fprintf(dlldata, "DLLDATA_ROUTINES(aProxyFileList, GET_DLL_CLSID)\n\n");
   end_cplusplus_guard(dlldata);
-  fclose(dlldata);
+  close_output_file(dlldata);
 }
 
 static char *eat_space(char *s)
@@ -541,11 +576,7 @@ void write_id_data(const statement_list_t *stmts)
 {
   if (!do_idfile) return;
 
-  idfile = fopen(idfile_name, "w");
-  if (! idfile) {
-    error("Could not open %s for output\n", idfile_name);
-    return;
-  }
+  idfile = open_output_file(idfile_name);
 
   fprintf(idfile, "/*** Autogenerated by WIDL %s ", PACKAGE_VERSION);
   fprintf(idfile, "from %s - Do not edit ***/\n\n", input_idl_name);
@@ -590,7 +621,125 @@ void write_id_data(const statement_list_t *stmts)
   end_cplusplus_guard(idfile);
   fprintf(idfile, "#undef MIDL_DEFINE_GUID\n" );
 
-  fclose(idfile);
+  close_output_file(idfile);
+}
+
+static const struct output_generator
+{
+  int *enabled;
+  void (*write)(const statement_list_t *stmts);
+  const char *name;
+} output_generators[] =
+{
+  { &do_header,    write_header,     "header" },
+  { &do_idfile,    write_id_data,    "idfile" },
+  { &do_proxies,   write_proxies,    "proxy" },
+  { &do_client,    write_client,     "client" },
+  { &do_server,    write_server,     "server" },
+  { &do_regscript, write_regscript,  "regscript" },
+#ifdef __REACTOS__
+  { &do_typelib,   write_typelib,    "typelib" },
+#else
+  { &do_typelib,   write_typelib_regscript, "typelib" },
+#endif
+  { &do_dlldata,   write_dlldata,    "dlldata" },
+  { &do_depfile,   write_depfile,    "depfile" },
+  { NULL,          write_local_stubs, "local stubs" },
+};
+
+static void run_output_generator(const struct output_generator *gen, const statement_list_t *stmts)
+{
+  time_phase_start("output", gen->name);
+  gen->write(stmts);
+  time_phase_end();
+}
+
+/* The generators only read the parsed statements, apart from scratch data
+ * such as type format string offsets that each of them resets before use.
+ * When several outputs are requested, each generator runs in a process of
+ * its own, which gets a private copy of that scratch data and of the static
+ * output state of the generator, so they can all run at the same time.  The
+ * properties of the types that several of them use are computed first, so
+ * that they inherit them.  That state is still global, so there is no
+ * threaded fallback: without fork() the generators run one after another. */
+void write_outputs(const statement_list_t *stmts)
+{
+  unsigned int i, count = 0;
+
+  for (i = 0; i < ARRAY_SIZE(output_generators); i++)
+  {
+    const struct output_generator *gen = &output_generators[i];
+    if (gen->enabled ? *gen->enabled : local_stubs_name != NULL) count++;
+  }
+
+#ifndef _WIN32
+  if (count > 1)
+  {
+    pid_t pids[ARRAY_SIZE(output_generators)];
+    int timings[ARRAY_SIZE(output_generators)][2];
+    int status, ret = 0;
+
+    fflush(NULL);
+    time_phase_start("outputs", NULL);
+    fill_typegen_cache(stmts);
+    for (i = 0; i < ARRAY_SIZE(output_generators); i++)
+    {
+      const struct output_generator *gen = &output_generators[i];
+
+      pids[i] = 0;
+      timings[i][0] = timings[i][1] = -1;
+      if (gen->enabled ? !*gen->enabled : !local_stubs_name) continue;
+      if (time_report && pipe(timings[i]) == -1) timings[i][0] = timings[i][1] = -1;
+      if ((pids[i] = fork()) == -1)
+      {
+        chat("Could not fork: %s\n", strerror(errno));
+        run_output_generator(gen, stmts);
+        pids[i] = 0;
+      }
+      else if (!pids[i])
+      {
+        unsigned int mark = time_report_mark();
+
+        run_output_generator(gen, stmts);
+        if (timings[i][1] != -1) time_report_send(timings[i][1], mark);
+        fflush(NULL);
+        /* skip the atexit handlers, they would remove the outputs */
+        _exit(0);
+      }
+      if (timings[i][1] != -1) close(timings[i][1]);
+    }
+
+    /* wait for all of them, the outputs are removed on failure */
+    for (i = 0; i < ARRAY_SIZE(output_generators); i++)
+    {
+      if (timings[i][0] != -1)
+      {
+        if (pids[i]) time_report_receive(timings[i][0]);
+        close(timings[i][0]);
+      }
+      if (!pids[i]) continue;
+      if (waitpid(pids[i], &status, 0) != pids[i]) ret = 1;
+      else if (!WIFEXITED(status)) ret = 1;
+      else if (WEXITSTATUS(status) && !ret) ret = WEXITSTATUS(status);
+    }
+    time_phase_end();
+    if (ret) exit(ret);
+    return;
+  }
+#endif
+
+  time_phase_start("outputs", NULL);
+  for (i = 0; i < ARRAY_SIZE(output_generators); i++)
+  {
+    const struct output_generator *gen = &output_generators[i];
+
+    /* the disabled generators return right away, don't report them */
+    if (gen->enabled ? *gen->enabled : local_stubs_name != NULL)
+      run_output_generator(gen, stmts);
+    else
+      gen->write(stmts);
+  }
+  time_phase_end();
 }
 
 static void init_argv0_dir( const char *argv0 )
@@ -614,13 +763,478 @@ static void init_argv0_dir( const char *argv0 )
 #endif
 }
 
+/* options that only apply to a single input file, these are also accepted in batch files */
+static int set_input_option(int optc, const char *arg)
+{
+  switch(optc) {
+  case ACF_OPTION:
+    acf_name = xstrdup(arg);
+    break;
+  case DLLDATA_OPTION:
+    dlldata_name = xstrdup(arg);
+    break;
+  case DEPFILE_OPTION:
+    do_depfile = 1;
+    break;
+  case DEPFILE_NAME_OPTION:
+    do_depfile = 1;
+    depfile_name = xstrdup(arg);
+    break;
+  case LOCAL_STUBS_OPTION:
+    do_everything = 0;
+    local_stubs_name = xstrdup(arg);
+    break;
+  case OLD_TYPELIB_OPTION:
+    do_old_typelib = 1;
+    break;
+  case RT_OPTION:
+    winrt_mode = 1;
+    break;
+  case RT_NS_PREFIX:
+    use_abi_namespace = 1;
+    break;
+  case 'c':
+    do_everything = 0;
+    do_client = 1;
+    break;
+  case 'C':
+    client_name = xstrdup(arg);
+    break;
+  case 'h':
+    do_everything = 0;
+    do_header = 1;
+    break;
+  case 'H':
+    header_name = xstrdup(arg);
+    break;
+  case 'o':
+    output_name = xstrdup(arg);
+    break;
+  case 'p':
+    do_everything = 0;
+    do_proxies = 1;
+    break;
+  case 'P':
+    proxy_name = xstrdup(arg);
+    break;
+  case 'r':
+    do_everything = 0;
+    do_regscript = 1;
+    break;
+  case 's':
+    do_everything = 0;
+    do_server = 1;
+    break;
+  case 'S':
+    server_name = xstrdup(arg);
+    break;
+  case 't':
+    do_everything = 0;
+    do_typelib = 1;
+    break;
+  case 'T':
+    typelib_name = xstrdup(arg);
+    break;
+  case 'u':
+    do_everything = 0;
+    do_idfile = 1;
+    break;
+  case 'U':
+    idfile_name = xstrdup(arg);
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+/* per-input state; the command line settings are the defaults for every batch entry */
+struct input_options
+{
+  int do_everything, do_header, do_typelib, do_old_typelib, do_proxies, do_client;
+  int do_server, do_regscript, do_idfile, do_dlldata, do_depfile, winrt_mode, use_abi_namespace;
+  char *output_name, *acf_name, *header_name, *local_stubs_name, *typelib_name, *dlldata_name;
+  char *proxy_name, *client_name, *server_name, *regscript_name, *idfile_name, *depfile_name;
+};
+
+static void save_input_options(struct input_options *opts)
+{
+  opts->do_everything = do_everything;
+  opts->do_header = do_header;
+  opts->do_typelib = do_typelib;
+  opts->do_old_typelib = do_old_typelib;
+  opts->do_proxies = do_proxies;
+  opts->do_client = do_client;
+  opts->do_server = do_server;
+  opts->do_regscript = do_regscript;
+  opts->do_idfile = do_idfile;
+  opts->do_dlldata = do_dlldata;
+  opts->do_depfile = do_depfile;
+  opts->winrt_mode = winrt_mode;
+  opts->use_abi_namespace = use_abi_namespace;
+  opts->output_name = output_name;
+  opts->acf_name = acf_name;
+  opts->header_name = header_name;
+  opts->local_stubs_name = local_stubs_name;
+  opts->typelib_name = typelib_name;
+  opts->dlldata_name = dlldata_name;
+  opts->proxy_name = proxy_name;
+  opts->client_name = client_name;
+  opts->server_name = server_name;
+  opts->regscript_name = regscript_name;
+  opts->idfile_name = idfile_name;
+  opts->depfile_name = depfile_name;
+}
+
+static void restore_input_options(const struct input_options *opts)
+{
+  do_everything = opts->do_everything;
+  do_header = opts->do_header;
+  do_typelib = opts->do_typelib;
+  do_old_typelib = opts->do_old_typelib;
+  do_proxies = opts->do_proxies;
+  do_client = opts->do_client;
+  do_server = opts->do_server;
+  do_regscript = opts->do_regscript;
+  do_idfile = opts->do_idfile;
+  do_dlldata = opts->do_dlldata;
+  do_depfile = opts->do_depfile;
+  winrt_mode = opts->winrt_mode;
+  use_abi_namespace = opts->use_abi_namespace;
+  output_name = opts->output_name;
+  acf_name = opts->acf_name;
+  header_name = opts->header_name;
+  local_stubs_name = opts->local_stubs_name;
+  typelib_name = opts->typelib_name;
+  dlldata_name = opts->dlldata_name;
+  proxy_name = opts->proxy_name;
+  client_name = opts->client_name;
+  server_name = opts->server_name;
+  regscript_name = opts->regscript_name;
+  idfile_name = opts->idfile_name;
+  depfile_name = opts->depfile_name;
+}
+
+static void set_output_names(void)
+{
+  /* if nothing specified, try to guess output type from the output file name */
+  if (output_name && do_everything && !do_header && !do_typelib && !do_proxies &&
+      !do_client && !do_server && !do_regscript && !do_idfile && !do_dlldata)
+  {
+      do_everything = 0;
+      if (strendswith( output_name, ".h" )) do_header = 1;
+      else if (strendswith( output_name, ".tlb" )) do_typelib = 1;
+      else if (strendswith( output_name, "_p.c" )) do_proxies = 1;
+      else if (strendswith( output_name, "_c.c" )) do_client = 1;
+      else if (strendswith( output_name, "_s.c" )) do_server = 1;
+      else if (strendswith( output_name, "_i.c" )) do_idfile = 1;
+      else if (strendswith( output_name, "_r.res" )) do_regscript = 1;
+      else if (strendswith( output_name, "_t.res" )) do_typelib = 1;
+      else if (strendswith( output_name, "dlldata.c" )) do_dlldata = 1;
+      else do_everything = 1;
+  }
+
+  if(do_everything) {
+    set_everything(TRUE);
+  }
+
+  if (!output_name) output_name = dup_basename(input_name, ".idl");
+
+  if (do_header + do_typelib + do_proxies + do_client +
+      do_server + do_regscript + do_idfile + do_dlldata == 1)
+  {
+      if (do_header) header_name = output_name;
+      else if (do_typelib) typelib_name = output_name;
+      else if (do_proxies) proxy_name = output_name;
+      else if (do_client) client_name = output_name;
+      else if (do_server) server_name = output_name;
+      else if (do_regscript) regscript_name = output_name;
+      else if (do_idfile) idfile_name = output_name;
+      else if (do_dlldata) dlldata_name = output_name;
+  }
+
+  if (!dlldata_name && do_dlldata)
+    dlldata_name = xstrdup("dlldata.c");
+}
+
+#ifndef _WIN32
+static long get_peak_rss(void)
+{
+  struct rusage self;
+#ifdef __linux__
+  char line[256];
+  long peak = -1;
+  FILE *f;
+
+  /* ru_maxrss also counts the memory of the process widl was started from,
+   * which dwarfs ours when that is e.g. a Python script */
+  if ((f = fopen("/proc/self/status", "r")))
+  {
+    while (fgets(line, sizeof(line), f))
+      if (sscanf(line, "VmHWM: %ld kB", &peak) == 1) break;
+    fclose(f);
+    if (peak >= 0) return peak;
+  }
+#endif
+  if (getrusage(RUSAGE_SELF, &self)) return -1;
+  return self.ru_maxrss;
+}
+#endif
+
+static void write_stats(struct parse_context *ctx)
+{
+#ifndef _WIN32
+  struct rusage children;
+  long peak;
+#endif
+
+  fprintf(stderr, "Statistics for %s:\n", input_idl_name);
+  dump_symbol_stats(ctx);
+#ifndef _WIN32
+  /* the output generators run in child processes */
+  if ((peak = get_peak_rss()) >= 0 && !getrusage(RUSAGE_CHILDREN, &children))
+    fprintf(stderr, "Peak RSS: %ld KiB, %ld KiB for output generators\n",
+            peak, (long)children.ru_maxrss);
+#endif
+}
+
+static void compile_input(void)
+{
+  struct parse_context *ctx;
+  FILE *input = NULL;
+  int ret;
+
+  if (!header_name) {
+    header_name = dup_basename(input_name, ".idl");
+    strcat(header_name, ".h");
+  }
+
+  if (!typelib_name && do_typelib) {
+    typelib_name = dup_basename(input_name, ".idl");
+    strcat(typelib_name, ".tlb");
+  }
+
+  if (!proxy_name && do_proxies) {
+    proxy_name = dup_basename(input_name, ".idl");
+    strcat(proxy_name, "_p.c");
+  }
+
+  if (!client_name && do_client) {
+    client_name = dup_basename(input_name, ".idl");
+    strcat(client_name, "_c.c");
+  }
+
+  if (!server_name && do_server) {
+    server_name = dup_basename(input_name, ".idl");
+    strcat(server_name, "_s.c");
+  }
+
+  if (!regscript_name && do_regscript) {
+    regscript_name = dup_basename(input_name, ".idl");
+    strcat(regscript_name, "_r.rgs");
+  }
+
+  if (!idfile_name && do_idfile) {
+    idfile_name = dup_basename(input_name, ".idl");
+    strcat(idfile_name, "_i.c");
+  }
+
+  if (!depfile_name && do_depfile) {
+    depfile_name = dup_basename(input_name, ".idl");
+    strcat(depfile_name, ".d");
+  }
+
+  if (do_proxies) proxy_token = dup_basename_token(proxy_name,"_p.c");
+  if (do_client) client_token = dup_basename_token(client_name,"_c.c");
+  if (do_server) server_token = dup_basename_token(server_name,"_s.c");
+  if (do_regscript) regscript_token = dup_basename_token(regscript_name,"_r.rgs");
+
+  time_phase_start("compile", input_name);
+
+  ctx = parse_context_create();
+  if (!no_preprocess)
+  {
+    chat("Starting preprocess\n");
+
+    if (preprocess_only)
+    {
+        if (wpp_parse( input_name, stdout )) exit(1);
+        exit(0);
+    }
+    /* the preprocessed text is kept in memory and scanned from there */
+    scan_input( ctx, input_name );
+  }
+  else {
+    if(!(input = fopen(input_name, "r"))) {
+      fprintf(stderr, "Could not open %s for input\n", input_name);
+      exit(1);
+    }
+    scan_file( ctx, input );
+    add_dependency(input_name);
+  }
+
+  header_token = make_token(header_name);
+
+  time_phase_start("parse", input_name);
+  ret = parser_parse( ctx );
+  time_phase_end();
+  if (do_stats) write_stats(ctx);
+
+  parse_context_free( ctx );
+  if (input) fclose(input);
+
+  if(ret) {
+    exit(1);
+  }
+
+  time_phase_end();
+  write_time_report(input_idl_name);
+
+  /* Everything has been done successfully, don't delete any files.  */
+  set_everything(FALSE);
+  local_stubs_name = NULL;
+  do_depfile = 0;
+}
+
+/* Compile every file listed in a batch file.  Each line names one input file
+ * along with the options that only apply to it, such as its output names.
+ * Imported files are parsed once and shared between all inputs. */
+static void compile_batch(const char *name)
+{
+  struct input_options defaults;
+  char *line = NULL, **args = NULL, *p;
+  size_t len = 0;
+  unsigned int line_no = 0, count, size = 0;
+  int optc, opti;
+  FILE *f;
+
+  if (!(f = fopen(name, "r")))
+    error("Could not open %s for input\n", name);
+
+  save_input_options(&defaults);
+  while (widl_getline(&line, &len, f))
+  {
+    line_no++;
+    count = 0;
+    for (p = strtok(line, " \t\r\n"); p; p = strtok(NULL, " \t\r\n"))
+    {
+      if (count + 2 > size)
+      {
+        size = max(size * 2, 16);
+        args = xrealloc(args, size * sizeof(*args));
+      }
+      if (!count) args[count++] = (char *)name;
+      args[count++] = p;
+    }
+    if (!count || args[1][0] == '#') continue;
+    args[count] = NULL;
+
+    restore_input_options(&defaults);
+    optind = 1;
+    while((optc = getopt_long_only(count, args, short_options, long_options, &opti)) != EOF)
+      if (!set_input_option(optc, optarg))
+        error("%s:%u: option not allowed in a batch file\n", name, line_no);
+    if (optind != count - 1)
+      error("%s:%u: expected a single input file\n", name, line_no);
+
+    input_idl_name = input_name = xstrdup(args[optind]);
+    set_output_names();
+    chat("Compiling %s\n", input_name);
+    compile_input();
+
+    reset_types();
+    reset_dependencies();
+  }
+  free(args);
+  free(line);
+  fclose(f);
+}
+
+/* Options that do not apply to a single input make up the key of a compile
+ * server, requests are only handled if their key is the same.  Relative paths
+ * are made absolute since the client may run in another directory. */
+static char *add_option_key(char *key, int optc, const char *arg)
+{
+  char *ret, cwd[PATH_MAX] = "";
+
+  if ((optc == 'I' || optc == SYSROOT_OPTION || optc == IMPORT_CACHE_OPTION) &&
+      arg[0] != '/' && getcwd(cwd, sizeof(cwd)))
+    strcat(cwd, "/");
+  ret = strmake("%s%d %s%s\n", key ? key : "", optc, cwd, arg ? arg : "");
+  free(key);
+  return ret;
+}
+
+/* parse the imports given to the compile server so that every request finds them in memory */
+static void preload_import(const char *name)
+{
+  struct parse_context *ctx;
+  FILE *f;
+
+  if (!(f = tmpfile()))
+    error("Could not create a temporary file: %s\n", strerror(errno));
+  fprintf(f, "import \"%s\";\n", name);
+  rewind(f);
+
+  chat("Preloading %s\n", name);
+  input_idl_name = input_name = xstrdup("widl-server");
+  do_everything = 0;
+  set_everything(FALSE);
+  do_depfile = 0;
+  acf_name = local_stubs_name = NULL;
+  ctx = parse_context_create();
+  scan_file(ctx, f);
+  if (parser_parse(ctx)) exit(1);
+  parse_context_free(ctx);
+  fclose(f);
+  write_time_report(name);
+
+  reset_types();
+}
+
+/* read an importlib given to the compile server, it is then shared by every request */
+static void preload_typelib(const char *name)
+{
+  chat("Preloading %s\n", name);
+  preload_importlib(name);
+  write_time_report(name);
+  reset_dependencies();
+}
+
+/* handle a compile request, called in a process forked from the compile server */
+int compile_request(int argc, char *argv[])
+{
+  char *key = NULL;
+  int optc, opti;
+
+  optind = 1;
+  opterr = 0;
+  while((optc = getopt_long_only(argc, argv, short_options, long_options, &opti)) != EOF)
+    if (!set_input_option(optc, optarg))
+      key = add_option_key(key, optc, optarg);
+
+  if (optind != argc - 1 || strcmp(key ? key : "", server_key ? server_key : ""))
+  {
+    /* let the client do it on its own */
+    set_everything(FALSE);
+    local_stubs_name = NULL;
+    do_depfile = 0;
+    return COMPILE_SERVER_RETRY;
+  }
+
+  input_idl_name = input_name = xstrdup(argv[optind]);
+  set_output_names();
+  compile_input();
+  return 0;
+}
+
 int main(int argc,char *argv[])
 {
   int optc;
-  int ret = 0;
   int opti = 0;
-  char *output_name = NULL;
+  int ret;
   const char *sysroot = "";
+  char *p;
 
   signal( SIGTERM, exit_on_signal );
   signal( SIGINT, exit_on_signal );
@@ -629,20 +1243,21 @@ int main(int argc,char *argv[])
 #endif
   init_argv0_dir( argv[0] );
 
+  if ((p = getenv( COMPILE_SERVER_ENV )) && *p && run_compile_client( p, argc, argv, &ret ))
+    return ret;
+
   now = time(NULL);
 
   while((optc = getopt_long_only(argc, argv, short_options, long_options, &opti)) != EOF) {
+    if (set_input_option(optc, optarg)) continue;
+    if (optc != SERVER_OPTION) server_key = add_option_key(server_key, optc, optarg);
     switch(optc) {
-    case DLLDATA_OPTION:
-      dlldata_name = xstrdup(optarg);
-      break;
     case DLLDATA_ONLY_OPTION:
       do_everything = 0;
       do_dlldata = 1;
       break;
-    case LOCAL_STUBS_OPTION:
-      do_everything = 0;
-      local_stubs_name = xstrdup(optarg);
+    case IMPORT_CACHE_OPTION:
+      import_cache_dir = xstrdup(optarg);
       break;
     case NOSTDINC_OPTION:
       stdinc = 0;
@@ -663,15 +1278,17 @@ int main(int argc,char *argv[])
     case PRINT_HELP:
       fprintf(stderr, "%s", usage);
       return 0;
-    case RT_OPTION:
-      winrt_mode = 1;
-      break;
-    case RT_NS_PREFIX:
-      use_abi_namespace = 1;
+    case STATS_OPTION:
+      do_stats = 1;
       break;
     case SYSROOT_OPTION:
       sysroot = xstrdup(optarg);
       break;
+    case TIME_REPORT_OPTION:
+      if (!optarg || !strcmp(optarg, "text")) time_report = TIME_REPORT_TEXT;
+      else if (!strcmp(optarg, "json")) time_report = TIME_REPORT_JSON;
+      else error("Invalid time report format '%s'\n", optarg);
+      break;
     case WIN32_OPTION:
       pointer_size = 4;
       break;
@@ -688,8 +1305,8 @@ int main(int argc,char *argv[])
       if(win64_packing != 2 && win64_packing != 4 && win64_packing != 8)
           error("Packing must be one of 2, 4 or 8\n");
       break;
-    case ACF_OPTION:
-      acf_name = xstrdup(optarg);
+    case BATCH_OPTION:
+      batch_name = xstrdup(optarg);
       break;
     case APP_CONFIG_OPTION:
       /* widl does not distinguish between app_mode and default mode,
@@ -701,32 +1318,20 @@ int main(int argc,char *argv[])
     case 'b':
       set_target( optarg );
       break;
-    case 'c':
-      do_everything = 0;
-      do_client = 1;
-      break;
-    case 'C':
-      client_name = xstrdup(optarg);
-      break;
     case 'd':
       debuglevel = strtol(optarg, NULL, 0);
       break;
     case 'D':
       wpp_add_cmdline_define(optarg);
+      import_cache_add_key("-D%s", optarg);
       break;
     case 'E':
       do_everything = 0;
       preprocess_only = 1;
       break;
-    case 'h':
-      do_everything = 0;
-      do_header = 1;
-      break;
-    case 'H':
-      header_name = xstrdup(optarg);
-      break;
     case 'I':
       wpp_add_include_path(optarg);
+      import_cache_add_key("-I%s", optarg);
       break;
     case 'm':
       if (!strcmp( optarg, "32" )) pointer_size = 4;
@@ -735,9 +1340,6 @@ int main(int argc,char *argv[])
     case 'N':
       no_preprocess = 1;
       break;
-    case 'o':
-      output_name = xstrdup(optarg);
-      break;
     case 'O':
       if (!strcmp( optarg, "s" )) stub_mode = MODE_Os;
       else if (!strcmp( optarg, "i" )) stub_mode = MODE_Oi;
@@ -746,47 +1348,15 @@ int main(int argc,char *argv[])
       else if (!strcmp( optarg, "icf" )) stub_mode = MODE_Oif;
       else error( "Invalid argument '-O%s'\n", optarg );
       break;
-    case 'p':
-      do_everything = 0;
-      do_proxies = 1;
-      break;
-    case 'P':
-      proxy_name = xstrdup(optarg);
-      break;
-    case 'r':
-      do_everything = 0;
-      do_regscript = 1;
-      break;
-    case 's':
-      do_everything = 0;
-      do_server = 1;
-      break;
-    case 'S':
-      server_name = xstrdup(optarg);
-      break;
-    case 't':
-      do_everything = 0;
-      do_typelib = 1;
-      break;
-    case OLD_TYPELIB_OPTION:
-      do_old_typelib = 1;
-      break;
-    case 'T':
-      typelib_name = xstrdup(optarg);
-      break;
-    case 'u':
-      do_everything = 0;
-      do_idfile = 1;
-      break;
-    case 'U':
-      idfile_name = xstrdup(optarg);
-      break;
     case 'V':
       printf("%s", version_string);
       return 0;
     case 'W':
       pedantic = 1;
       break;
+    case SERVER_OPTION:
+      server_socket = xstrdup(optarg);
+      break;
     default:
       fprintf(stderr, "%s", usage);
       return 1;
@@ -801,6 +1371,7 @@ int main(int argc,char *argv[])
           strrchr (exe_path, '/')[1] = '\0';
       }
       wpp_add_include_path(strmake("%s%s/%s", sysroot, exe_path, BIN_TO_INCLUDEDIR));
+      import_cache_add_key("-I%s%s/%s", sysroot, exe_path, BIN_TO_INCLUDEDIR);
   }
 
   switch (target_cpu)
@@ -822,66 +1393,44 @@ int main(int argc,char *argv[])
       pointer_size = 4;
       break;
   }
+  import_cache_add_key("target=%u/%u", target_cpu, pointer_size);
 
-  /* if nothing specified, try to guess output type from the output file name */
-  if (output_name && do_everything && !do_header && !do_typelib && !do_proxies &&
-      !do_client && !do_server && !do_regscript && !do_idfile && !do_dlldata)
-  {
-      do_everything = 0;
-      if (strendswith( output_name, ".h" )) do_header = 1;
-      else if (strendswith( output_name, ".tlb" )) do_typelib = 1;
-      else if (strendswith( output_name, "_p.c" )) do_proxies = 1;
-      else if (strendswith( output_name, "_c.c" )) do_client = 1;
-      else if (strendswith( output_name, "_s.c" )) do_server = 1;
-      else if (strendswith( output_name, "_i.c" )) do_idfile = 1;
-      else if (strendswith( output_name, "_r.res" )) do_regscript = 1;
-      else if (strendswith( output_name, "_t.res" )) do_typelib = 1;
-      else if (strendswith( output_name, "dlldata.c" )) do_dlldata = 1;
-      else do_everything = 1;
-  }
-
-  if(do_everything) {
-    set_everything(TRUE);
+  if (server_socket) {
+    if (batch_name) {
+      fprintf(stderr, "%s", usage);
+      return 1;
+    }
   }
-
-  if (!output_name) output_name = dup_basename(input_name, ".idl");
-
-  if (do_header + do_typelib + do_proxies + do_client +
-      do_server + do_regscript + do_idfile + do_dlldata == 1)
-  {
-      if (do_header) header_name = output_name;
-      else if (do_typelib) typelib_name = output_name;
-      else if (do_proxies) proxy_name = output_name;
-      else if (do_client) client_name = output_name;
-      else if (do_server) server_name = output_name;
-      else if (do_regscript) regscript_name = output_name;
-      else if (do_idfile) idfile_name = output_name;
-      else if (do_dlldata) dlldata_name = output_name;
+  else if (batch_name) {
+    if (optind < argc || preprocess_only) {
+      fprintf(stderr, "%s", usage);
+      return 1;
+    }
   }
+  else {
+    set_output_names();
 
-  if (!dlldata_name && do_dlldata)
-    dlldata_name = xstrdup("dlldata.c");
-
-  if(optind < argc) {
-    if (do_dlldata && !do_everything) {
-      struct list filenames = LIST_INIT(filenames);
-      for ( ; optind < argc; ++optind)
-        add_filename_node(&filenames, argv[optind]);
+    if(optind < argc) {
+      if (do_dlldata && !do_everything) {
+        struct list filenames = LIST_INIT(filenames);
+        for ( ; optind < argc; ++optind)
+          add_filename_node(&filenames, argv[optind]);
 
-      write_dlldata_list(&filenames, 0 /* FIXME */ );
-      free_filename_nodes(&filenames);
-      return 0;
+        write_dlldata_list(&filenames, 0 /* FIXME */ );
+        free_filename_nodes(&filenames);
+        return 0;
+      }
+      else if (optind != argc - 1) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+      }
+      else
+        input_idl_name = input_name = xstrdup(argv[optind]);
     }
-    else if (optind != argc - 1) {
+    else {
       fprintf(stderr, "%s", usage);
       return 1;
     }
-    else
-      input_idl_name = input_name = xstrdup(argv[optind]);
-  }
-  else {
-    fprintf(stderr, "%s", usage);
-    return 1;
   }
 
   if(debuglevel)
@@ -891,121 +1440,43 @@ int main(int argc,char *argv[])
   }
 
   parser_debug = debuglevel & DEBUGLEVEL_TRACE ? 1 : 0;
-  yy_flex_debug = debuglevel & DEBUGLEVEL_TRACE ? 1 : 0;
 
   wpp_set_debug( (debuglevel & DEBUGLEVEL_PPLEX) != 0,
                  (debuglevel & DEBUGLEVEL_PPTRACE) != 0,
                  (debuglevel & DEBUGLEVEL_PPMSG) != 0 );
 
-  if (!header_name) {
-    header_name = dup_basename(input_name, ".idl");
-    strcat(header_name, ".h");
-  }
-
-  if (!typelib_name && do_typelib) {
-    typelib_name = dup_basename(input_name, ".idl");
-    strcat(typelib_name, ".tlb");
-  }
-
-  if (!proxy_name && do_proxies) {
-    proxy_name = dup_basename(input_name, ".idl");
-    strcat(proxy_name, "_p.c");
-  }
-
-  if (!client_name && do_client) {
-    client_name = dup_basename(input_name, ".idl");
-    strcat(client_name, "_c.c");
-  }
-
-  if (!server_name && do_server) {
-    server_name = dup_basename(input_name, ".idl");
-    strcat(server_name, "_s.c");
-  }
-
-  if (!regscript_name && do_regscript) {
-    regscript_name = dup_basename(input_name, ".idl");
-    strcat(regscript_name, "_r.rgs");
-  }
-
-  if (!idfile_name && do_idfile) {
-    idfile_name = dup_basename(input_name, ".idl");
-    strcat(idfile_name, "_i.c");
-  }
-
-  if (do_proxies) proxy_token = dup_basename_token(proxy_name,"_p.c");
-  if (do_client) client_token = dup_basename_token(client_name,"_c.c");
-  if (do_server) server_token = dup_basename_token(server_name,"_s.c");
-  if (do_regscript) regscript_token = dup_basename_token(regscript_name,"_r.rgs");
-
   add_widl_version_define();
   wpp_add_define("_WIN32", NULL);
 
   atexit(rm_tempfile);
-  if (!no_preprocess)
+  init_types();
+
+  if (server_socket)
   {
-    chat("Starting preprocess\n");
+    struct input_options defaults;
 
-    if (!preprocess_only)
+    save_input_options(&defaults);
+    for ( ; optind < argc; optind++)
     {
-        FILE *output;
-        int fd;
-        char *name = xmalloc( strlen(header_name) + 8 );
-
-        strcpy( name, header_name );
-        strcat( name, ".XXXXXX" );
-
-        if ((fd = mkstemps( name, 0 )) == -1)
-            error("Could not generate a temp name from %s\n", name);
-
-        temp_name = name;
-        if (!(output = fdopen(fd, "wt")))
-            error("Could not open fd %s for writing\n", name);
-
-        ret = wpp_parse( input_name, output );
-        fclose( output );
+      if (strendswith(argv[optind], ".tlb"))
+        preload_typelib(argv[optind]);
+      else
+        preload_import(argv[optind]);
+      restore_input_options(&defaults);
     }
-    else
-    {
-        ret = wpp_parse( input_name, stdout );
-    }
-
-    if(ret) exit(1);
-    if(preprocess_only) exit(0);
-    if(!(parser_in = fopen(temp_name, "r"))) {
-      fprintf(stderr, "Could not open %s for input\n", temp_name);
-      return 1;
-    }
-  }
-  else {
-    if(!(parser_in = fopen(input_name, "r"))) {
-      fprintf(stderr, "Could not open %s for input\n", input_name);
-      return 1;
-    }
-  }
-
-  header_token = make_token(header_name);
-
-  init_types();
-  ret = parser_parse();
-
-  fclose(parser_in);
-
-  if(ret) {
-    exit(1);
+    run_compile_server(server_socket);
   }
-
-  /* Everything has been done successfully, don't delete any files.  */
-  set_everything(FALSE);
-  local_stubs_name = NULL;
+  else if (batch_name)
+    compile_batch(batch_name);
+  else
+    compile_input();
 
   return 0;
 }
 
 static void rm_tempfile(void)
 {
-  abort_import();
-  if(temp_name)
-    unlink(temp_name);
+  remove_temp_output();
   if (do_header)
     unlink(header_name);
   if (local_stubs_name)
@@ -1022,4 +1493,6 @@ static void rm_tempfile(void)
     unlink(proxy_name);
   if (do_typelib)
     unlink(typelib_name);
+  if (do_depfile)
+    unlink(depfile_name);
 }
@@ -91,6 +91,30 @@ typedef struct tagMSFT_ImpFile {
     char filename[0]; /* preceded by two bytes of encoded (length << 2) + flags in the low two bits. */
 } MSFT_ImpFile;
 
+/* the pointer, safearray and user-defined TYPEDESCs already allocated,
+ * keyed on their VT and the type they refer to */
+struct typedesc_index_entry
+{
+    int vt;      /* 0 for a free entry */
+    int target;
+    int offset;
+};
+
+/* build-time index of the entries of a segment by a hash of their contents;
+ * the hash tables stored in the file only have 32 and 128 buckets */
+struct segment_index_entry
+{
+    unsigned int hash;
+    int offset;  /* -1 for a free entry */
+};
+
+struct segment_index
+{
+    struct segment_index_entry *entries;
+    unsigned int size;
+    unsigned int count;
+};
+
 typedef struct _msft_typelib_t
 {
     typelib_t *typelib;
@@ -106,6 +130,14 @@ typedef struct _msft_typelib_t
 
     INT help_string_dll_offset;
 
+    struct segment_index guid_index;
+    struct segment_index name_index;
+    struct segment_index string_index;
+
+    struct typedesc_index_entry *typedesc_index;
+    unsigned int typedesc_index_size;
+    unsigned int typedesc_index_count;
+
     struct _msft_typeinfo_t *typeinfos;
     struct _msft_typeinfo_t *last_typeinfo;
 } msft_typelib_t;
@@ -113,7 +145,7 @@ typedef struct _msft_typelib_t
 typedef struct _msft_typeinfo_t
 {
     msft_typelib_t *typelib;
-    MSFT_TypeInfoBase *typeinfo;
+    int typeinfo_offset;   /* of the MSFT_TypeInfoBase, the segment moves as it grows */
 
     int typekind;
 
@@ -138,6 +170,11 @@ typedef struct _msft_typeinfo_t
     struct _msft_typeinfo_t *next_typeinfo;
 } msft_typeinfo_t;
 
+static inline MSFT_TypeInfoBase *ctl2_typeinfo_base(const msft_typeinfo_t *typeinfo)
+{
+    return (MSFT_TypeInfoBase *)&typeinfo->typelib->typelib_segment_data[MSFT_SEG_TYPEINFO][typeinfo->typeinfo_offset];
+}
+
 
 
 /*================== Internal functions ===================================*/
@@ -194,6 +231,61 @@ static void ctl2_init_segdir(
     }
 }
 
+static unsigned int ctl2_hash_data(const void *data, int size)
+{
+    const unsigned char *p = data;
+    unsigned int hash = 2166136261u;
+
+    /* 32-bit FNV-1a */
+    while (size--) {
+	hash ^= *p++;
+	hash *= 16777619;
+    }
+    return hash;
+}
+
+static void ctl2_index_add(struct segment_index *index, unsigned int hash, int offset)
+{
+    unsigned int mask, i;
+
+    if (2 * (index->count + 1) > index->size) {
+	struct segment_index_entry *old = index->entries;
+	unsigned int old_size = index->size;
+
+	index->size = old_size ? 2 * old_size : 256;
+	index->entries = xmalloc(index->size * sizeof(*old));
+	memset(index->entries, 0xff, index->size * sizeof(*old));
+	index->count = 0;
+	for (i = 0; i < old_size; i++)
+	    if (old[i].offset != -1) ctl2_index_add(index, old[i].hash, old[i].offset);
+	free(old);
+    }
+
+    mask = index->size - 1;
+    for (i = hash & mask; index->entries[i].offset != -1; i = (i + 1) & mask);
+    index->entries[i].hash = hash;
+    index->entries[i].offset = offset;
+    index->count++;
+}
+
+/* returns the offsets of the entries with a given hash one by one, starting at *pos = hash */
+static int ctl2_index_next(const struct segment_index *index, unsigned int hash, unsigned int *pos)
+{
+    const struct segment_index_entry *entry;
+    unsigned int mask = index->size - 1;
+
+    if (!index->size) return -1;
+
+    for (;; (*pos)++) {
+	entry = &index->entries[*pos & mask];
+	if (entry->offset == -1) return -1;
+	if (entry->hash == hash) {
+	    (*pos)++;
+	    return entry->offset;
+	}
+    }
+}
+
 /****************************************************************************
  *	ctl2_hash_guid
  *
@@ -228,24 +320,27 @@ static int ctl2_hash_guid(
  */
 static int ctl2_find_guid(
 	msft_typelib_t *typelib,   /* [I] The typelib to operate against. */
-	int hash_key,              /* [I] The hash key for the guid. */
 	REFGUID guid)              /* [I] The guid to find. */
 {
+    unsigned int hash = ctl2_hash_data(guid, sizeof(GUID)), pos = hash;
     int offset;
-    MSFT_GuidEntry *guidentry;
-
-    offset = typelib->typelib_guidhash_segment[hash_key];
-    while (offset != -1) {
-	guidentry = (MSFT_GuidEntry *)&typelib->typelib_segment_data[MSFT_SEG_GUID][offset];
-
-	if (!memcmp(guidentry, guid, sizeof(GUID))) return offset;
 
-	offset = guidentry->next_hash;
+    while ((offset = ctl2_index_next(&typelib->guid_index, hash, &pos)) != -1) {
+	if (!memcmp(&typelib->typelib_segment_data[MSFT_SEG_GUID][offset], guid, sizeof(GUID)))
+	    break;
     }
 
     return offset;
 }
 
+/* names compare case-insensitively, so only hash the length and the case-insensitive
+ * hash code stored with the encoded name, which are the fields ctl2_find_name matches */
+static unsigned int ctl2_hash_name(const char *name)
+{
+    int key = *((const int *)name) & 0xffff00ff;
+    return ctl2_hash_data(&key, sizeof(key));
+}
+
 /****************************************************************************
  *	ctl2_find_name
  *
@@ -263,20 +358,17 @@ static int ctl2_find_name(
 	msft_typelib_t *typelib,   /* [I] The typelib to operate against. */
 	char *name)                /* [I] The encoded name to find. */
 {
+    unsigned int hash = ctl2_hash_name(name), pos = hash;
     int offset;
     int *namestruct;
 
-    offset = typelib->typelib_namehash_segment[name[2] & 0x7f];
-    while (offset != -1) {
+    while ((offset = ctl2_index_next(&typelib->name_index, hash, &pos)) != -1) {
 	namestruct = (int *)&typelib->typelib_segment_data[MSFT_SEG_NAME][offset];
 
 	if (!((namestruct[2] ^ *((int *)name)) & 0xffff00ff)) {
 	    /* hash codes and lengths match, final test */
 	    if (!strncasecmp(name+4, (void *)(namestruct+3), name[0])) break;
 	}
-
-	/* move to next item in hash bucket */
-	offset = namestruct[1];
     }
 
     return offset;
@@ -385,15 +477,12 @@ static int ctl2_encode_string(
 /****************************************************************************
  *	ctl2_alloc_segment
  *
- *  Allocates memory from a segment in a type library.
+ *  Allocates memory from a segment in a type library.  The segment starts
+ *  with the size estimated by ctl2_estimate_segments and doubles as needed.
  *
  * RETURNS
  *
  *  Success: The offset within the segment of the new data area.
- *
- * BUGS
- *
- *  Does not (yet) handle the case where the allocated segment memory needs to grow.
  */
 static int ctl2_alloc_segment(
 	msft_typelib_t *typelib,         /* [I] The type library in which to allocate. */
@@ -404,6 +493,7 @@ static int ctl2_alloc_segment(
     int offset;
 
     if(!typelib->typelib_segment_data[segment]) {
+	if (!block_size) block_size = typelib->typelib_segment_block_length[segment];
 	if (!block_size) block_size = 0x2000;
 
 	typelib->typelib_segment_block_length[segment] = block_size;
@@ -418,15 +508,6 @@ static int ctl2_alloc_segment(
 	block_size = typelib->typelib_segment_block_length[segment];
 	block = xrealloc(typelib->typelib_segment_data[segment], block_size << 1);
 
-	if (segment == MSFT_SEG_TYPEINFO) {
-	    /* TypeInfos have a direct pointer to their memory space, so we have to fix them up. */
-	    msft_typeinfo_t *typeinfo;
-
-	    for (typeinfo = typelib->typeinfos; typeinfo; typeinfo = typeinfo->next_typeinfo) {
-		typeinfo->typeinfo = (void *)&block[((unsigned char *)typeinfo->typeinfo) - typelib->typelib_segment_data[segment]];
-	    }
-	}
-
 	memset(block + block_size, 0x57, block_size);
 	typelib->typelib_segment_block_length[segment] = block_size << 1;
 	typelib->typelib_segment_data[segment] = block;
@@ -438,6 +519,92 @@ static int ctl2_alloc_segment(
     return offset;
 }
 
+static unsigned int ctl2_hash_typedesc(int vt, int target)
+{
+    unsigned int hash = (unsigned int)target * 0x9e3779b1u;
+    return (hash ^ (hash >> 16)) + vt;
+}
+
+/****************************************************************************
+ *	ctl2_find_typedesc
+ *
+ *  Finds the first TYPEDESC of the given VT referring to a type.
+ *
+ * RETURNS
+ *
+ *  Success: The offset of the TYPEDESC within the segment.
+ *  Failure: -1.
+ */
+static int ctl2_find_typedesc(
+	msft_typelib_t *typelib, /* [I] The type library to search. */
+	int vt,                  /* [I] The VT of the TYPEDESC. */
+	int target)              /* [I] The encoded type it refers to. */
+{
+    unsigned int mask = typelib->typedesc_index_size - 1, i;
+    struct typedesc_index_entry *entry;
+
+    if (!typelib->typedesc_index_size) return -1;
+
+    for (i = ctl2_hash_typedesc(vt, target) & mask; ; i = (i + 1) & mask) {
+	entry = &typelib->typedesc_index[i];
+	if (!entry->vt) return -1;
+	if (entry->vt == vt && entry->target == target) return entry->offset;
+    }
+}
+
+static void ctl2_index_typedesc(msft_typelib_t *typelib, int vt, int target, int offset)
+{
+    unsigned int mask, i;
+
+    if (2 * (typelib->typedesc_index_count + 1) > typelib->typedesc_index_size) {
+	struct typedesc_index_entry *old = typelib->typedesc_index;
+	unsigned int old_size = typelib->typedesc_index_size;
+
+	typelib->typedesc_index_size = old_size ? 2 * old_size : 64;
+	typelib->typedesc_index = xmalloc(typelib->typedesc_index_size * sizeof(*old));
+	memset(typelib->typedesc_index, 0, typelib->typedesc_index_size * sizeof(*old));
+	typelib->typedesc_index_count = 0;
+	for (i = 0; i < old_size; i++)
+	    if (old[i].vt) ctl2_index_typedesc(typelib, old[i].vt, old[i].target, old[i].offset);
+	free(old);
+    }
+
+    mask = typelib->typedesc_index_size - 1;
+    for (i = ctl2_hash_typedesc(vt, target) & mask; typelib->typedesc_index[i].vt; i = (i + 1) & mask)
+	if (typelib->typedesc_index[i].vt == vt && typelib->typedesc_index[i].target == target)
+	    return;  /* keep the first one, as a scan of the segment would find */
+
+    typelib->typedesc_index[i].vt = vt;
+    typelib->typedesc_index[i].target = target;
+    typelib->typedesc_index[i].offset = offset;
+    typelib->typedesc_index_count++;
+}
+
+/****************************************************************************
+ *	ctl2_alloc_typedesc
+ *
+ *  Allocates a TYPEDESC in a type library and adds it to the index.
+ *
+ * RETURNS
+ *
+ *  Success: The offset of the new TYPEDESC within the segment.
+ */
+static int ctl2_alloc_typedesc(
+	msft_typelib_t *typelib, /* [I] The type library in which to allocate. */
+	int desc,                /* [I] The VT along with the mix field in the high word. */
+	int target)              /* [I] The encoded type or array it refers to. */
+{
+    int offset, *typedata;
+
+    offset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
+    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][offset];
+    typedata[0] = desc;
+    typedata[1] = target;
+
+    ctl2_index_typedesc(typelib, desc & 0xffff, target, offset);
+    return offset;
+}
+
 /****************************************************************************
  *	ctl2_alloc_typeinfo
  *
@@ -516,7 +683,7 @@ static int ctl2_alloc_guid(
 
     hash_key = ctl2_hash_guid(&guid->guid);
 
-    offset = ctl2_find_guid(typelib, hash_key, &guid->guid);
+    offset = ctl2_find_guid(typelib, &guid->guid);
     if (offset != -1)
     {
         if (is_warning_enabled(2368))
@@ -534,6 +701,7 @@ static int ctl2_alloc_guid(
 
     guid_space->next_hash = typelib->typelib_guidhash_segment[hash_key];
     typelib->typelib_guidhash_segment[hash_key] = offset;
+    ctl2_index_add(&typelib->guid_index, ctl2_hash_data(&guid->guid, sizeof(GUID)), offset);
 
     return offset;
 }
@@ -578,6 +746,7 @@ static int ctl2_alloc_name(
 	name_space->next_hash = typelib->typelib_namehash_segment[encoded_name[2] & 0x7f];
 
     typelib->typelib_namehash_segment[encoded_name[2] & 0x7f] = offset;
+    ctl2_index_add(&typelib->name_index, ctl2_hash_name(encoded_name), offset);
 
     typelib->typelib_header.nametablecount += 1;
     typelib->typelib_header.nametablechars += *encoded_name;
@@ -602,15 +771,18 @@ static int ctl2_alloc_string(
 {
     int length;
     int offset;
+    unsigned int hash, pos;
     unsigned char *string_space;
     char *encoded_string;
 
     length = ctl2_encode_string(string, &encoded_string);
 
-    for (offset = 0; offset < typelib->typelib_segdir[MSFT_SEG_STRING].length;
-	 offset += (((typelib->typelib_segment_data[MSFT_SEG_STRING][offset + 1] << 8) |
-	      typelib->typelib_segment_data[MSFT_SEG_STRING][offset + 0]) + 5) & ~3) {
-	if (!memcmp(encoded_string, typelib->typelib_segment_data[MSFT_SEG_STRING] + offset, length)) return offset;
+    hash = pos = ctl2_hash_data(encoded_string, length);
+    while ((offset = ctl2_index_next(&typelib->string_index, hash, &pos)) != -1) {
+	if (!memcmp(encoded_string, typelib->typelib_segment_data[MSFT_SEG_STRING] + offset, length)) {
+	    free(encoded_string);
+	    return offset;
+	}
     }
 
     offset = ctl2_alloc_segment(typelib, MSFT_SEG_STRING, length, 0);
@@ -618,6 +790,7 @@ static int ctl2_alloc_string(
     string_space = typelib->typelib_segment_data[MSFT_SEG_STRING] + offset;
     memcpy(string_space, encoded_string, length);
     free(encoded_string);
+    ctl2_index_add(&typelib->string_index, hash, offset);
 
     return offset;
 }
@@ -754,29 +927,6 @@ static void alloc_importinfo(msft_typelib_t *typelib, importinfo_t *importinfo)
     }
 }
 
-static importinfo_t *find_importinfo(msft_typelib_t *typelib, const char *name)
-{
-    importlib_t *importlib;
-    int i;
-
-    chat("search importlib %s\n", name);
-
-    if(!name)
-        return NULL;
-
-    LIST_FOR_EACH_ENTRY( importlib, &typelib->typelib->importlibs, importlib_t, entry )
-    {
-        for(i=0; i < importlib->ntypeinfos; i++) {
-            if(!strcmp(name, importlib->importinfos[i].name)) {
-                chat("Found %s in importlib.\n", name);
-                return importlib->importinfos+i;
-            }
-        }
-    }
-
-    return NULL;
-}
-
 static void add_structure_typeinfo(msft_typelib_t *typelib, type_t *structure);
 static void add_interface_typeinfo(msft_typelib_t *typelib, type_t *interface);
 static void add_enum_typeinfo(msft_typelib_t *typelib, type_t *enumeration);
@@ -903,12 +1053,7 @@ static int encode_type(
             break;
         }
 
-	for (typeoffset = 0; typeoffset < typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length; typeoffset += 8) {
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-	    if (((typedata[0] & 0xffff) == VT_PTR) && (typedata[1] == target_type)) break;
-	}
-
-	if (typeoffset == typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length) {
+	if ((typeoffset = ctl2_find_typedesc(typelib, VT_PTR, target_type)) == -1) {
 	    int mix_field;
 	    
 	    if (target_type & 0x80000000) {
@@ -918,11 +1063,7 @@ static int encode_type(
 		mix_field = ((typedata[0] >> 16) == 0x7fff)? 0x7fff: 0x7ffe;
 	    }
 
-	    typeoffset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-
-	    typedata[0] = (mix_field << 16) | VT_PTR;
-	    typedata[1] = target_type;
+	    typeoffset = ctl2_alloc_typedesc(typelib, (mix_field << 16) | VT_PTR, target_type);
 	}
 
 	*encoded_type = typeoffset;
@@ -939,12 +1080,7 @@ static int encode_type(
 	encode_type(typelib, next_vt, type_alias_get_aliasee_type(type_array_get_element_type(type)),
         &target_type, &child_size);
 
-	for (typeoffset = 0; typeoffset < typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length; typeoffset += 8) {
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-	    if (((typedata[0] & 0xffff) == VT_SAFEARRAY) && (typedata[1] == target_type)) break;
-	}
-
-	if (typeoffset == typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length) {
+	if ((typeoffset = ctl2_find_typedesc(typelib, VT_SAFEARRAY, target_type)) == -1) {
 	    int mix_field;
 	    
 	    if (target_type & 0x80000000) {
@@ -954,11 +1090,7 @@ static int encode_type(
 		mix_field = ((typedata[0] >> 16) == 0x7fff)? 0x7fff: 0x7ffe;
 	    }
 
-	    typeoffset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-
-	    typedata[0] = (mix_field << 16) | VT_SAFEARRAY;
-	    typedata[1] = target_type;
+	    typeoffset = ctl2_alloc_typedesc(typelib, (mix_field << 16) | VT_SAFEARRAY, target_type);
 	}
 
 	*encoded_type = typeoffset;
@@ -978,7 +1110,7 @@ static int encode_type(
                 type->name, type->typelib_idx);
             typeinfo_offset = typelib->typelib_typeinfo_offsets[type->typelib_idx];
         }
-        else if ((importinfo = find_importinfo(typelib, type->name)))
+        else if ((importinfo = find_importinfo(typelib->typelib, type->name)))
         {
             chat("encode_type: VT_USERDEFINED - found imported type %s in %s\n",
                 type->name, importinfo->importlib->name);
@@ -1035,18 +1167,8 @@ static int encode_type(
 
             typeinfo_offset = typelib->typelib_typeinfo_offsets[type->typelib_idx];
         }
-	for (typeoffset = 0; typeoffset < typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length; typeoffset += 8) {
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-	    if ((typedata[0] == ((0x7fff << 16) | VT_USERDEFINED)) && (typedata[1] == typeinfo_offset)) break;
-	}
-
-	if (typeoffset == typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length) {
-	    typeoffset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-
-	    typedata[0] = (0x7fff << 16) | VT_USERDEFINED;
-	    typedata[1] = typeinfo_offset;
-	}
+	if ((typeoffset = ctl2_find_typedesc(typelib, VT_USERDEFINED, typeinfo_offset)) == -1)
+	    typeoffset = ctl2_alloc_typedesc(typelib, (0x7fff << 16) | VT_USERDEFINED, typeinfo_offset);
 
 	*encoded_type = typeoffset;
         break;
@@ -1117,11 +1239,7 @@ static int encode_var(
             elements *= type_array_get_dim(atype);
         }
 
-        typeoffset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
-        typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-
-        typedata[0] = (0x7ffe << 16) | VT_CARRAY;
-        typedata[1] = arrayoffset;
+        typeoffset = ctl2_alloc_typedesc(typelib, (0x7ffe << 16) | VT_CARRAY, arrayoffset);
 
         *encoded_type = typeoffset;
         *decoded_size = 20 /*sizeof(ARRAYDESC)*/ + (num_dims - 1) * 8 /*sizeof(SAFEARRAYBOUND)*/;
@@ -1141,12 +1259,7 @@ static int encode_var(
             return 0;
         }
 
-	for (typeoffset = 0; typeoffset < typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length; typeoffset += 8) {
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-	    if (((typedata[0] & 0xffff) == VT_PTR) && (typedata[1] == target_type)) break;
-	}
-
-	if (typeoffset == typelib->typelib_segdir[MSFT_SEG_TYPEDESC].length) {
+	if ((typeoffset = ctl2_find_typedesc(typelib, VT_PTR, target_type)) == -1) {
 	    int mix_field;
 
 	    if (target_type & 0x80000000) {
@@ -1159,11 +1272,7 @@ static int encode_var(
 		mix_field = ((typedata[0] >> 16) == 0x7fff)? 0x7fff: 0x7ffe;
 	    }
 
-	    typeoffset = ctl2_alloc_segment(typelib, MSFT_SEG_TYPEDESC, 8, 0);
-	    typedata = (void *)&typelib->typelib_segment_data[MSFT_SEG_TYPEDESC][typeoffset];
-
-	    typedata[0] = (mix_field << 16) | VT_PTR;
-	    typedata[1] = target_type;
+	    typeoffset = ctl2_alloc_typedesc(typelib, (mix_field << 16) | VT_PTR, target_type);
 	}
 
 	*encoded_type = typeoffset;
@@ -1320,7 +1429,7 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
 
     chat("add_func_desc(%p,%d)\n", typeinfo, index);
 
-    id = ((0x6000 | (typeinfo->typeinfo->datatype2 & 0xffff)) << 16) | index;
+    id = ((0x6000 | (ctl2_typeinfo_base(typeinfo)->datatype2 & 0xffff)) << 16) | index;
 
     switch(typeinfo->typekind) {
     case TKIND_DISPATCH:
@@ -1462,7 +1571,7 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
 
 
     /* find func with the same name - if it exists use its id */
-    for(i = 0; i < (typeinfo->typeinfo->cElement & 0xffff); i++) {
+    for(i = 0; i < (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff); i++) {
         if(name_offset == typeinfo->func_names[i]) {
             id = typeinfo->func_indices[i];
             break;
@@ -1471,7 +1580,7 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
 
     /* find the first func with the same id and link via the hiword of typedata[4] */
     next_idx = index;
-    for(i = 0; i < (typeinfo->typeinfo->cElement & 0xffff); i++) {
+    for(i = 0; i < (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff); i++) {
         if(id == typeinfo->func_indices[i]) {
             next_idx = typeinfo->func_data[(typeinfo->func_offsets[i] >> 2) + 1 + 4] >> 16;
             typeinfo->func_data[(typeinfo->func_offsets[i] >> 2) + 1 + 4] &= 0xffff;
@@ -1485,7 +1594,7 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
     encode_var(typeinfo->typelib, type_function_get_rettype(func->declspec.type), func,
         &typedata[1], &decoded_size);
     typedata[2] = funcflags;
-    typedata[3] = ((52 /*sizeof(FUNCDESC)*/ + decoded_size) << 16) | typeinfo->typeinfo->cbSizeVft;
+    typedata[3] = ((52 /*sizeof(FUNCDESC)*/ + decoded_size) << 16) | ctl2_typeinfo_base(typeinfo)->cbSizeVft;
     typedata[4] = (next_idx << 16) | (callconv << 8) | (invokekind << 3) | funckind;
     if(num_defaults) typedata[4] |= 0x1000;
     if(entry_is_ord) typedata[4] |= 0x2000;
@@ -1570,7 +1679,7 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
         typeinfo->func_names   = xmalloc(typeinfo->funcs_allocated * sizeof(int));
         typeinfo->func_offsets = xmalloc(typeinfo->funcs_allocated * sizeof(int));
     }
-    if(typeinfo->funcs_allocated == (typeinfo->typeinfo->cElement & 0xffff)) {
+    if(typeinfo->funcs_allocated == (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff)) {
         typeinfo->funcs_allocated *= 2;
         typeinfo->func_indices = xrealloc(typeinfo->func_indices, typeinfo->funcs_allocated * sizeof(int));
         typeinfo->func_names   = xrealloc(typeinfo->func_names,   typeinfo->funcs_allocated * sizeof(int));
@@ -1578,30 +1687,30 @@ static HRESULT add_func_desc(msft_typeinfo_t* typeinfo, var_t *func, int index)
     }
 
     /* update the index data */
-    typeinfo->func_indices[typeinfo->typeinfo->cElement & 0xffff] = id; 
-    typeinfo->func_offsets[typeinfo->typeinfo->cElement & 0xffff] = offset;
-    typeinfo->func_names[typeinfo->typeinfo->cElement & 0xffff] = name_offset;
+    typeinfo->func_indices[ctl2_typeinfo_base(typeinfo)->cElement & 0xffff] = id; 
+    typeinfo->func_offsets[ctl2_typeinfo_base(typeinfo)->cElement & 0xffff] = offset;
+    typeinfo->func_names[ctl2_typeinfo_base(typeinfo)->cElement & 0xffff] = name_offset;
 
     /* ??? */
-    if (!typeinfo->typeinfo->res2) typeinfo->typeinfo->res2 = 0x20;
-    typeinfo->typeinfo->res2 <<= 1;
+    if (!ctl2_typeinfo_base(typeinfo)->res2) ctl2_typeinfo_base(typeinfo)->res2 = 0x20;
+    ctl2_typeinfo_base(typeinfo)->res2 <<= 1;
     /* ??? */
-    if (index < 2) typeinfo->typeinfo->res2 += num_params << 4;
+    if (index < 2) ctl2_typeinfo_base(typeinfo)->res2 += num_params << 4;
 
-    if (typeinfo->typeinfo->res3 == -1) typeinfo->typeinfo->res3 = 0;
-    typeinfo->typeinfo->res3 += 0x38 + num_params * 0x10;
-    if(num_defaults) typeinfo->typeinfo->res3 += num_params * 0x4;
+    if (ctl2_typeinfo_base(typeinfo)->res3 == -1) ctl2_typeinfo_base(typeinfo)->res3 = 0;
+    ctl2_typeinfo_base(typeinfo)->res3 += 0x38 + num_params * 0x10;
+    if(num_defaults) ctl2_typeinfo_base(typeinfo)->res3 += num_params * 0x4;
 
     /* adjust size of VTBL */
     if(funckind != 0x3 /* FUNC_STATIC */)
-        typeinfo->typeinfo->cbSizeVft += pointer_size;
+        ctl2_typeinfo_base(typeinfo)->cbSizeVft += pointer_size;
 
     /* Increment the number of function elements */
-    typeinfo->typeinfo->cElement += 1;
+    ctl2_typeinfo_base(typeinfo)->cElement += 1;
 
     namedata = typeinfo->typelib->typelib_segment_data[MSFT_SEG_NAME] + name_offset;
     if (*((INT *)namedata) == -1) {
-	*((INT *)namedata) = typeinfo->typelib->typelib_typeinfo_offsets[typeinfo->typeinfo->typekind >> 16];
+	*((INT *)namedata) = typeinfo->typelib->typelib_typeinfo_offsets[ctl2_typeinfo_base(typeinfo)->typekind >> 16];
         if(typeinfo->typekind == TKIND_MODULE)
             namedata[9] |= 0x10;
     } else
@@ -1639,7 +1748,7 @@ static HRESULT add_var_desc(msft_typeinfo_t *typeinfo, UINT index, var_t* var)
     int varflags = 0;
     const attr_t *attr;
     unsigned char *namedata;
-    int var_num = (typeinfo->typeinfo->cElement >> 16) & 0xffff;
+    int var_num = (ctl2_typeinfo_base(typeinfo)->cElement >> 16) & 0xffff;
 
     if (!var->name)
         var->name = gen_name();
@@ -1774,35 +1883,35 @@ static HRESULT add_var_desc(msft_typeinfo_t *typeinfo, UINT index, var_t* var)
     typedata[3] += var_type_size << 16 | var_kind;
 
     /* fix type alignment */
-    alignment = (typeinfo->typeinfo->typekind >> 11) & 0x1f;
+    alignment = (ctl2_typeinfo_base(typeinfo)->typekind >> 11) & 0x1f;
     if (alignment < var_alignment) {
 	alignment = var_alignment;
-	typeinfo->typeinfo->typekind &= ~0xffc0;
-	typeinfo->typeinfo->typekind |= alignment << 11 | alignment << 6;
+	ctl2_typeinfo_base(typeinfo)->typekind &= ~0xffc0;
+	ctl2_typeinfo_base(typeinfo)->typekind |= alignment << 11 | alignment << 6;
     }
 
     /* ??? */
-    if (!typeinfo->typeinfo->res2) typeinfo->typeinfo->res2 = 0x1a;
+    if (!ctl2_typeinfo_base(typeinfo)->res2) ctl2_typeinfo_base(typeinfo)->res2 = 0x1a;
     if ((index == 0) || (index == 1) || (index == 2) || (index == 4) || (index == 9)) {
-	typeinfo->typeinfo->res2 <<= 1;
+	ctl2_typeinfo_base(typeinfo)->res2 <<= 1;
     }
 
     /* ??? */
-    if (typeinfo->typeinfo->res3 == -1) typeinfo->typeinfo->res3 = 0;
-    typeinfo->typeinfo->res3 += 0x2c;
+    if (ctl2_typeinfo_base(typeinfo)->res3 == -1) ctl2_typeinfo_base(typeinfo)->res3 = 0;
+    ctl2_typeinfo_base(typeinfo)->res3 += 0x2c;
 
     /* increment the number of variable elements */
-    typeinfo->typeinfo->cElement += 0x10000;
+    ctl2_typeinfo_base(typeinfo)->cElement += 0x10000;
 
     /* pad data width to alignment */
-    typeinfo->typeinfo->size = (typeinfo->datawidth + (alignment - 1)) & ~(alignment - 1);
+    ctl2_typeinfo_base(typeinfo)->size = (typeinfo->datawidth + (alignment - 1)) & ~(alignment - 1);
 
     offset = ctl2_alloc_name(typeinfo->typelib, var->name);
     if (offset == -1) return E_OUTOFMEMORY;
 
     namedata = typeinfo->typelib->typelib_segment_data[MSFT_SEG_NAME] + offset;
     if (*((INT *)namedata) == -1) {
-	*((INT *)namedata) = typeinfo->typelib->typelib_typeinfo_offsets[typeinfo->typeinfo->typekind >> 16];
+	*((INT *)namedata) = typeinfo->typelib->typelib_typeinfo_offsets[ctl2_typeinfo_base(typeinfo)->typekind >> 16];
         if(typeinfo->typekind != TKIND_DISPATCH)
             namedata[9] |= 0x10;
     } else
@@ -1820,17 +1929,17 @@ static HRESULT add_impl_type(msft_typeinfo_t *typeinfo, type_t *ref, importinfo_
 {
     if(importinfo) {
         alloc_importinfo(typeinfo->typelib, importinfo);
-        typeinfo->typeinfo->datatype1 = importinfo->offset+1;
+        ctl2_typeinfo_base(typeinfo)->datatype1 = importinfo->offset+1;
     }else {
         if(ref->typelib_idx == -1)
             add_interface_typeinfo(typeinfo->typelib, ref);
         if(ref->typelib_idx == -1)
             error("add_impl_type: unable to add inherited interface\n");
 
-        typeinfo->typeinfo->datatype1 = typeinfo->typelib->typelib_typeinfo_offsets[ref->typelib_idx];
+        ctl2_typeinfo_base(typeinfo)->datatype1 = typeinfo->typelib->typelib_typeinfo_offsets[ref->typelib_idx];
     }
 
-    typeinfo->typeinfo->cImplTypes++;
+    ctl2_typeinfo_base(typeinfo)->cImplTypes++;
     return S_OK;
 }
 
@@ -1859,7 +1968,7 @@ static msft_typeinfo_t *create_msft_typeinfo(msft_typelib_t *typelib, enum type_
     *((int *)&typelib->typelib_segment_data[MSFT_SEG_NAME][nameoffset]) = typeinfo_offset;
 
     msft_typeinfo->typekind = kind;
-    msft_typeinfo->typeinfo = typeinfo;
+    msft_typeinfo->typeinfo_offset = typeinfo_offset;
 
     typeinfo->typekind |= kind | 0x20;
 
@@ -1978,7 +2087,7 @@ static msft_typeinfo_t *create_msft_typeinfo(msft_typelib_t *typelib, enum type_
 
 static void add_dispatch(msft_typelib_t *typelib)
 {
-    int guid_offset, impfile_offset, hash_key;
+    int guid_offset, impfile_offset;
     MSFT_GuidEntry guidentry;
     MSFT_ImpInfo impinfo;
     GUID stdole =        {0x00020430,0x0000,0x0000,{0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x46}};
@@ -1989,8 +2098,7 @@ static void add_dispatch(msft_typelib_t *typelib)
     guidentry.guid = stdole;
     guidentry.hreftype = 2;
     guidentry.next_hash = -1;
-    hash_key = ctl2_hash_guid(&guidentry.guid);
-    guid_offset = ctl2_find_guid(typelib, hash_key, &guidentry.guid);
+    guid_offset = ctl2_find_guid(typelib, &guidentry.guid);
     if (guid_offset == -1)
         guid_offset = ctl2_alloc_guid(typelib, &guidentry);
     impfile_offset = alloc_importfile(typelib, guid_offset, 2, 0, "stdole2.tlb");
@@ -2000,8 +2108,7 @@ static void add_dispatch(msft_typelib_t *typelib)
     guidentry.next_hash = -1;
     impinfo.flags = TKIND_INTERFACE << 24 | MSFT_IMPINFO_OFFSET_IS_GUID;
     impinfo.oImpFile = impfile_offset;
-    hash_key = ctl2_hash_guid(&guidentry.guid);
-    guid_offset = ctl2_find_guid(typelib, hash_key, &guidentry.guid);
+    guid_offset = ctl2_find_guid(typelib, &guidentry.guid);
     if (guid_offset == -1)
         guid_offset = ctl2_alloc_guid(typelib, &guidentry);
     impinfo.oGuid = guid_offset;
@@ -2026,7 +2133,7 @@ static void add_dispinterface_typeinfo(msft_typelib_t *typelib, type_t *dispinte
 
     if (inherit)
     {
-        importinfo = find_importinfo(typelib, inherit->name);
+        importinfo = find_importinfo(typelib->typelib, inherit->name);
 
         if (!importinfo && type_iface_get_inherit(inherit) && inherit->typelib_idx == -1)
             add_interface_typeinfo(typelib, inherit);
@@ -2040,16 +2147,16 @@ static void add_dispinterface_typeinfo(msft_typelib_t *typelib, type_t *dispinte
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_DISPATCH, dispinterface->name,
                                          dispinterface->attrs);
 
-    msft_typeinfo->typeinfo->size = pointer_size;
-    msft_typeinfo->typeinfo->typekind |= pointer_size << 11 | pointer_size << 6;
+    ctl2_typeinfo_base(msft_typeinfo)->size = pointer_size;
+    ctl2_typeinfo_base(msft_typeinfo)->typekind |= pointer_size << 11 | pointer_size << 6;
 
-    msft_typeinfo->typeinfo->flags |= 0x1000; /* TYPEFLAG_FDISPATCHABLE */
+    ctl2_typeinfo_base(msft_typeinfo)->flags |= 0x1000; /* TYPEFLAG_FDISPATCHABLE */
     add_dispatch(typelib);
 
     if (inherit)
     {
         add_impl_type(msft_typeinfo, inherit, importinfo);
-        msft_typeinfo->typeinfo->typekind |= 0x10;
+        ctl2_typeinfo_base(msft_typeinfo)->typekind |= 0x10;
     }
 
     /* count the number of inherited interfaces and non-local functions */
@@ -2062,10 +2169,10 @@ static void add_dispinterface_typeinfo(msft_typelib_t *typelib, type_t *dispinte
             if (!is_local(func->attrs)) num_funcs++;
         }
     }
-    msft_typeinfo->typeinfo->datatype2 = num_funcs << 16 | num_parents;
-    msft_typeinfo->typeinfo->cbSizeVft = num_funcs * pointer_size;
+    ctl2_typeinfo_base(msft_typeinfo)->datatype2 = num_funcs << 16 | num_parents;
+    ctl2_typeinfo_base(msft_typeinfo)->cbSizeVft = num_funcs * pointer_size;
 
-    msft_typeinfo->typeinfo->cImplTypes = 1;    /* IDispatch */
+    ctl2_typeinfo_base(msft_typeinfo)->cImplTypes = 1;    /* IDispatch */
 
     /* count the no of methods, as the variable indices come after the funcs */
     if (dispinterface->details.iface->disp_methods)
@@ -2120,7 +2227,7 @@ static void add_interface_typeinfo(msft_typelib_t *typelib, type_t *interface)
     inherit = type_iface_get_inherit(interface);
 
     if(inherit) {
-        ref_importinfo = find_importinfo(typelib, inherit->name);
+        ref_importinfo = find_importinfo(typelib->typelib, inherit->name);
 
         if(!ref_importinfo && type_iface_get_inherit(inherit) &&
            inherit->typelib_idx == -1)
@@ -2133,13 +2240,13 @@ static void add_interface_typeinfo(msft_typelib_t *typelib, type_t *interface)
 
     interface->typelib_idx = typelib->typelib_header.nrtypeinfos;
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_INTERFACE, interface->name, interface->attrs);
-    msft_typeinfo->typeinfo->size = pointer_size;
-    msft_typeinfo->typeinfo->typekind |= 0x0200;
-    msft_typeinfo->typeinfo->typekind |= pointer_size << 11;
+    ctl2_typeinfo_base(msft_typeinfo)->size = pointer_size;
+    ctl2_typeinfo_base(msft_typeinfo)->typekind |= 0x0200;
+    ctl2_typeinfo_base(msft_typeinfo)->typekind |= pointer_size << 11;
 
     for (derived = inherit; derived; derived = type_iface_get_inherit(derived))
         if (derived->name && !strcmp(derived->name, "IDispatch"))
-            msft_typeinfo->typeinfo->flags |= 0x1000; /* TYPEFLAG_FDISPATCHABLE */
+            ctl2_typeinfo_base(msft_typeinfo)->flags |= 0x1000; /* TYPEFLAG_FDISPATCHABLE */
 
     if(type_iface_get_inherit(interface))
         add_impl_type(msft_typeinfo, type_iface_get_inherit(interface),
@@ -2153,8 +2260,8 @@ static void add_interface_typeinfo(msft_typelib_t *typelib, type_t *interface)
             if (!is_local(func->attrs)) num_funcs++;
         }
     }
-    msft_typeinfo->typeinfo->datatype2 = num_funcs << 16 | num_parents;
-    msft_typeinfo->typeinfo->cbSizeVft = num_funcs * pointer_size;
+    ctl2_typeinfo_base(msft_typeinfo)->datatype2 = num_funcs << 16 | num_parents;
+    ctl2_typeinfo_base(msft_typeinfo)->cbSizeVft = num_funcs * pointer_size;
 
     STATEMENTS_FOR_EACH_FUNC( stmt_func, type_iface_get_stmts(interface) ) {
         var_t *func = stmt_func->u.var;
@@ -2182,7 +2289,7 @@ static void add_structure_typeinfo(msft_typelib_t *typelib, type_t *structure)
 
     structure->typelib_idx = typelib->typelib_header.nrtypeinfos;
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_RECORD, structure->name, structure->attrs);
-    msft_typeinfo->typeinfo->size = 0;
+    ctl2_typeinfo_base(msft_typeinfo)->size = 0;
 
     if (type_get_type(structure) == TYPE_STRUCT)
         fields = type_struct_get_fields(structure);
@@ -2207,7 +2314,7 @@ static void add_enum_typeinfo(msft_typelib_t *typelib, type_t *enumeration)
 
     enumeration->typelib_idx = typelib->typelib_header.nrtypeinfos;
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_ENUM, enumeration->name, enumeration->attrs);
-    msft_typeinfo->typeinfo->size = 0;
+    ctl2_typeinfo_base(msft_typeinfo)->size = 0;
 
     if (type_enum_get_values(enumeration))
         LIST_FOR_EACH_ENTRY( cur, type_enum_get_values(enumeration), var_t, entry )
@@ -2228,7 +2335,7 @@ static void add_union_typeinfo(msft_typelib_t *typelib, type_t *tunion)
 
     tunion->typelib_idx = typelib->typelib_header.nrtypeinfos;
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_UNION, tunion->name, tunion->attrs);
-    msft_typeinfo->typeinfo->size = 0;
+    ctl2_typeinfo_base(msft_typeinfo)->size = 0;
 
     if (type_union_get_cases(tunion))
         LIST_FOR_EACH_ENTRY(cur, type_union_get_cases(tunion), var_t, entry)
@@ -2260,10 +2367,10 @@ static void add_typedef_typeinfo(msft_typelib_t *typelib, type_t *tdef)
 
     if (msft_typeinfo)
     {
-        msft_typeinfo->typeinfo->datatype1 = datatype1;
-        msft_typeinfo->typeinfo->size = size;
-        msft_typeinfo->typeinfo->datatype2 = datatype2;
-        msft_typeinfo->typeinfo->typekind |= (alignment << 11 | alignment << 6);
+        ctl2_typeinfo_base(msft_typeinfo)->datatype1 = datatype1;
+        ctl2_typeinfo_base(msft_typeinfo)->size = size;
+        ctl2_typeinfo_base(msft_typeinfo)->datatype2 = datatype2;
+        ctl2_typeinfo_base(msft_typeinfo)->typekind |= (alignment << 11 | alignment << 6);
     }
 
     /* avoid adding duplicate type definitions */
@@ -2290,7 +2397,7 @@ static void add_coclass_typeinfo(msft_typelib_t *typelib, type_t *cls)
     ifaces = type_coclass_get_ifaces(cls);
     if (ifaces) LIST_FOR_EACH_ENTRY( iref, ifaces, ifref_t, entry ) num_ifaces++;
 
-    offset = msft_typeinfo->typeinfo->datatype1 = ctl2_alloc_segment(typelib, MSFT_SEG_REFERENCES,
+    offset = ctl2_typeinfo_base(msft_typeinfo)->datatype1 = ctl2_alloc_segment(typelib, MSFT_SEG_REFERENCES,
                                                                      num_ifaces * sizeof(*ref), 0);
 
     i = 0;
@@ -2350,9 +2457,9 @@ static void add_coclass_typeinfo(msft_typelib_t *typelib, type_t *cls)
     if(!have_default_source && first_source)
         first_source->flags |= 0x1;
 
-    msft_typeinfo->typeinfo->cImplTypes = num_ifaces;
-    msft_typeinfo->typeinfo->size = pointer_size;
-    msft_typeinfo->typeinfo->typekind |= 0x2200;
+    ctl2_typeinfo_base(msft_typeinfo)->cImplTypes = num_ifaces;
+    ctl2_typeinfo_base(msft_typeinfo)->size = pointer_size;
+    ctl2_typeinfo_base(msft_typeinfo)->typekind |= 0x2200;
 }
 
 static void add_module_typeinfo(msft_typelib_t *typelib, type_t *module)
@@ -2366,7 +2473,7 @@ static void add_module_typeinfo(msft_typelib_t *typelib, type_t *module)
 
     module->typelib_idx = typelib->typelib_header.nrtypeinfos;
     msft_typeinfo = create_msft_typeinfo(typelib, TKIND_MODULE, module->name, module->attrs);
-    msft_typeinfo->typeinfo->typekind |= 0x0a00;
+    ctl2_typeinfo_base(msft_typeinfo)->typekind |= 0x0a00;
 
     STATEMENTS_FOR_EACH_FUNC( stmt, module->details.module->stmts ) {
         var_t *func = stmt->u.var;
@@ -2374,7 +2481,7 @@ static void add_module_typeinfo(msft_typelib_t *typelib, type_t *module)
             idx++;
     }
 
-    msft_typeinfo->typeinfo->size = idx;
+    ctl2_typeinfo_base(msft_typeinfo)->size = idx;
 }
 
 static void add_type_typeinfo(msft_typelib_t *typelib, type_t *type)
@@ -2575,19 +2682,20 @@ static void ctl2_write_segment(msft_typelib_t *typelib, int segment)
         put_data(typelib->typelib_segment_data[segment], typelib->typelib_segdir[segment].length);
 }
 
-static void ctl2_finalize_typeinfos(msft_typelib_t *typelib, int filesize)
+static int ctl2_finalize_typeinfos(msft_typelib_t *typelib, int filesize)
 {
     msft_typeinfo_t *typeinfo;
 
     for (typeinfo = typelib->typeinfos; typeinfo; typeinfo = typeinfo->next_typeinfo) {
-	typeinfo->typeinfo->memoffset = filesize;
+	ctl2_typeinfo_base(typeinfo)->memoffset = filesize;
 	if (typeinfo->func_data)
-	    filesize += typeinfo->func_data[0] + ((typeinfo->typeinfo->cElement & 0xffff) * 12);
+	    filesize += typeinfo->func_data[0] + ((ctl2_typeinfo_base(typeinfo)->cElement & 0xffff) * 12);
 	if (typeinfo->var_data)
-	    filesize += typeinfo->var_data[0] + (((typeinfo->typeinfo->cElement >> 16) & 0xffff) * 12);
+	    filesize += typeinfo->var_data[0] + (((ctl2_typeinfo_base(typeinfo)->cElement >> 16) & 0xffff) * 12);
         if (typeinfo->func_data || typeinfo->var_data)
             filesize += 4;
     }
+    return filesize;
 }
 
 static int ctl2_finalize_segment(msft_typelib_t *typelib, int filepos, int segment)
@@ -2620,20 +2728,20 @@ static void ctl2_write_typeinfos(msft_typelib_t *typelib)
         if (typeinfo->var_data)
             put_data(typeinfo->var_data + 1, typeinfo->var_data[0]);
         if (typeinfo->func_indices)
-            put_data(typeinfo->func_indices, (typeinfo->typeinfo->cElement & 0xffff) * 4);
+            put_data(typeinfo->func_indices, (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff) * 4);
         if (typeinfo->var_indices)
-            put_data(typeinfo->var_indices, (typeinfo->typeinfo->cElement >> 16) * 4);
+            put_data(typeinfo->var_indices, (ctl2_typeinfo_base(typeinfo)->cElement >> 16) * 4);
         if (typeinfo->func_names)
-            put_data(typeinfo->func_names,   (typeinfo->typeinfo->cElement & 0xffff) * 4);
+            put_data(typeinfo->func_names,   (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff) * 4);
         if (typeinfo->var_names)
-            put_data(typeinfo->var_names,   (typeinfo->typeinfo->cElement >> 16) * 4);
+            put_data(typeinfo->var_names,   (ctl2_typeinfo_base(typeinfo)->cElement >> 16) * 4);
         if (typeinfo->func_offsets)
-            put_data(typeinfo->func_offsets, (typeinfo->typeinfo->cElement & 0xffff) * 4);
+            put_data(typeinfo->func_offsets, (ctl2_typeinfo_base(typeinfo)->cElement & 0xffff) * 4);
         if (typeinfo->var_offsets) {
             int add = 0, i, offset;
             if(typeinfo->func_data)
                 add = typeinfo->func_data[0];
-            for(i = 0; i < (typeinfo->typeinfo->cElement >> 16); i++) {
+            for(i = 0; i < (ctl2_typeinfo_base(typeinfo)->cElement >> 16); i++) {
                 offset = typeinfo->var_offsets[i];
                 offset += add;
                 put_data(&offset, 4);
@@ -2642,6 +2750,36 @@ static void ctl2_write_typeinfos(msft_typelib_t *typelib)
     }
 }
 
+static void dump_typelib_stats(const msft_typelib_t *typelib, int filepos)
+{
+    static const char * const segment_names[MSFT_SEG_MAX] =
+    {
+        "typeinfo", "importinfo", "importfiles", "references", "guidhash", "guid",
+        "namehash", "name", "string", "typedesc", "arraydesc", "custdata",
+        "custdataguid", "unknown", "unknown2"
+    };
+    int i, total = 0;
+
+    fprintf(stderr, "Typelib %s: %d bytes\n  %-16s %10s %10s\n", typelib_name, filepos,
+            "segment", "used", "allocated");
+    for (i = 0; i < MSFT_SEG_MAX; i++)
+    {
+        if (!typelib->typelib_segment_data[i]) continue;
+        fprintf(stderr, "  %-16s %10d %10d\n", segment_names[i], typelib->typelib_segdir[i].length,
+                typelib->typelib_segment_block_length[i]);
+        total += typelib->typelib_segdir[i].length;
+    }
+    fprintf(stderr, "  %-16s %10d\n", "segments", total);
+    fprintf(stderr, "  guid index: %u entries in %u slots\n",
+            typelib->guid_index.count, typelib->guid_index.size);
+    fprintf(stderr, "  name index: %u entries in %u slots\n",
+            typelib->name_index.count, typelib->name_index.size);
+    fprintf(stderr, "  string index: %u entries in %u slots\n",
+            typelib->string_index.count, typelib->string_index.size);
+    fprintf(stderr, "  typedesc index: %u entries in %u slots\n",
+            typelib->typedesc_index_count, typelib->typedesc_index_size);
+}
+
 static void save_all_changes(msft_typelib_t *typelib)
 {
     int filepos;
@@ -2666,10 +2804,12 @@ static void save_all_changes(msft_typelib_t *typelib)
     filepos += ctl2_finalize_segment(typelib, filepos, MSFT_SEG_CUSTDATA);
     filepos += ctl2_finalize_segment(typelib, filepos, MSFT_SEG_CUSTDATAGUID);
 
-    ctl2_finalize_typeinfos(typelib, filepos);
+    filepos = ctl2_finalize_typeinfos(typelib, filepos);
+    if (do_stats) dump_typelib_stats(typelib, filepos);
 
     byte_swapped = 0;
     init_output_buffer();
+    reserve_output_buffer(filepos);
 
     put_data(&typelib->typelib_header, sizeof(typelib->typelib_header));
     if(typelib->typelib_header.varflags & 0x100)
@@ -2709,6 +2849,108 @@ static void save_all_changes(msft_typelib_t *typelib)
     else flush_output_buffer( typelib_name );
 }
 
+/* rough upper bounds of what each type adds to the segments */
+static void estimate_var_list(int *sizes, const var_list_t *vars)
+{
+    const var_t *var;
+
+    if (vars) LIST_FOR_EACH_ENTRY( var, vars, const var_t, entry )
+    {
+        if (var->name) sizes[MSFT_SEG_NAME] += strlen(var->name) + 16;
+        sizes[MSFT_SEG_TYPEDESC] += 8;
+    }
+}
+
+static void estimate_func(int *sizes, const var_t *func)
+{
+    sizes[MSFT_SEG_NAME] += strlen(func->name) + 16;
+    sizes[MSFT_SEG_TYPEDESC] += 8;
+    estimate_var_list(sizes, type_function_get_args(func->declspec.type));
+}
+
+static void estimate_type(int *sizes, const type_t *type)
+{
+    const statement_t *stmt;
+    const var_t *func;
+    const char *str;
+
+    sizes[MSFT_SEG_TYPEINFO] += sizeof(MSFT_TypeInfoBase);
+    if (type->name) sizes[MSFT_SEG_NAME] += strlen(type->name) + 16;
+    if (is_attr(type->attrs, ATTR_UUID)) sizes[MSFT_SEG_GUID] += sizeof(MSFT_GuidEntry);
+    if ((str = get_attrp(type->attrs, ATTR_HELPSTRING))) sizes[MSFT_SEG_STRING] += strlen(str) + 8;
+
+    switch (type_get_type_detect_alias(type))
+    {
+    case TYPE_INTERFACE:
+        if (!type_is_defined(type)) break;
+        STATEMENTS_FOR_EACH_FUNC( stmt, type_iface_get_stmts(type) )
+            estimate_func(sizes, stmt->u.var);
+        if (type_dispiface_get_methods(type))
+            LIST_FOR_EACH_ENTRY( func, type_dispiface_get_methods(type), const var_t, entry )
+                estimate_func(sizes, func);
+        estimate_var_list(sizes, type_dispiface_get_props(type));
+        break;
+    case TYPE_MODULE:
+        if (!type->details.module) break;
+        STATEMENTS_FOR_EACH_FUNC( stmt, type->details.module->stmts )
+            estimate_func(sizes, stmt->u.var);
+        break;
+    case TYPE_STRUCT:
+        if (type_is_defined(type)) estimate_var_list(sizes, type_struct_get_fields(type));
+        break;
+    case TYPE_UNION:
+    case TYPE_ENCAPSULATED_UNION:
+        if (type_is_defined(type)) estimate_var_list(sizes, type_union_get_cases(type));
+        break;
+    case TYPE_ENUM:
+        if (type_is_defined(type)) estimate_var_list(sizes, type_enum_get_values(type));
+        break;
+    default:
+        break;
+    }
+}
+
+/****************************************************************************
+ *	ctl2_estimate_segments
+ *
+ *  Walks the library statements to size the segments that grow with the
+ *  number of types and members, so that large typelibs don't have to
+ *  reallocate them over and over.
+ */
+static void ctl2_estimate_segments(
+	msft_typelib_t *typelib) /* [I] The type library to size. */
+{
+    int sizes[MSFT_SEG_MAX] = { 0 };
+    const statement_t *stmt;
+    const type_list_t *type_entry;
+    int i, block_size;
+
+    if (typelib->typelib->stmts)
+        LIST_FOR_EACH_ENTRY( stmt, typelib->typelib->stmts, const statement_t, entry ) {
+            switch (stmt->type) {
+            case STMT_TYPE:
+            case STMT_TYPEREF:
+            case STMT_MODULE:
+                estimate_type(sizes, stmt->u.type);
+                break;
+            case STMT_TYPEDEF:
+                for (type_entry = stmt->u.type_list; type_entry; type_entry = type_entry->next) {
+                    estimate_type(sizes, type_entry->type);
+                    estimate_type(sizes, type_alias_get_aliasee_type(type_entry->type));
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+    for (i = 0; i < MSFT_SEG_MAX; i++) {
+        if (sizes[i] <= 0x2000) continue;
+        for (block_size = 0x2000; block_size < sizes[i]; block_size <<= 1);
+        typelib->typelib_segment_block_length[i] = block_size;
+    }
+}
+
 int create_msft_typelib(typelib_t *typelib)
 {
     msft_typelib_t *msft;
@@ -2728,6 +2970,7 @@ int create_msft_typelib(typelib_t *typelib)
 
     ctl2_init_header(msft);
     ctl2_init_segdir(msft);
+    ctl2_estimate_segments(msft);
 
     msft->typelib_header.varflags |= (pointer_size == 8) ? SYS_WIN64 : SYS_WIN32;
 
@@ -2775,6 +3018,10 @@ int create_msft_typelib(typelib_t *typelib)
             add_entry(msft, stmt);
 
     save_all_changes(msft);
+    free(msft->guid_index.entries);
+    free(msft->name_index.entries);
+    free(msft->string_index.entries);
+    free(msft->typedesc_index);
     free(msft);
     return 1;
 }
@@ -78,14 +78,18 @@ struct sltg_typelib
 {
     typelib_t *typelib;
     struct sltg_data index;
+    struct symbol_table index_offsets;  /* index string -> offset + 1 */
     struct sltg_data name_table;
+    struct symbol_table name_offsets;   /* name -> offset + 1 */
     struct sltg_library library;
     struct sltg_block *blocks;
+    struct sltg_block *last_block;
     int n_file_blocks;
     int first_block;
     int typeinfo_count;
     int typeinfo_size;
     struct sltg_block *typeinfo;
+    struct sltg_block *last_typeinfo;
 };
 
 struct sltg_hrefmap
@@ -261,11 +265,16 @@ static void init_sltg_data(struct sltg_data *data)
     data->data = xmalloc(0x10);
 }
 
-static int add_index(struct sltg_data *index, const char *name)
+static int add_index(struct sltg_typelib *sltg, const char *name)
 {
+    struct sltg_data *index = &sltg->index;
+    void **offset = symbol_table_add_copy(&sltg->index_offsets, name);
     int name_offset = index->size;
     int new_size = index->size + strlen(name) + 1;
 
+    if (*offset) return (size_t)*offset - 1;
+    *offset = (void *)(size_t)(name_offset + 1);
+
     chat("add_index: name_offset %d, \"%s\"\n", name_offset, name);
 
     if (new_size > index->allocated)
@@ -280,21 +289,27 @@ static int add_index(struct sltg_data *index, const char *name)
     return name_offset;
 }
 
-static void init_index(struct sltg_data *index)
+static void init_index(struct sltg_typelib *sltg)
 {
     static const char compobj[] = { 1,'C','o','m','p','O','b','j',0 };
 
-    init_sltg_data(index);
+    init_sltg_data(&sltg->index);
+    memset(&sltg->index_offsets, 0, sizeof(sltg->index_offsets));
 
-    add_index(index, compobj);
+    add_index(sltg, compobj);
 }
 
 static int add_name(struct sltg_typelib *sltg, const char *name)
 {
+    void **offset = symbol_table_add_copy(&sltg->name_offsets, name);
     int name_offset = sltg->name_table.size;
     int new_size = sltg->name_table.size + strlen(name) + 1 + 8;
     int aligned_size;
 
+    /* names are only referred to by offset, so each one is stored once */
+    if (*offset) return (size_t)*offset - 1;
+    *offset = (void *)(size_t)(name_offset + 1);
+
     chat("add_name: %s\n", name);
 
     aligned_size = (new_size + 0x1f) & ~0x1f;
@@ -310,9 +325,10 @@ static int add_name(struct sltg_typelib *sltg, const char *name)
     }
 
     memset(sltg->name_table.data + sltg->name_table.size, 0xff, 8);
+    /* clear alignment */
+    memset(sltg->name_table.data + sltg->name_table.size + 8, 0, new_size - sltg->name_table.size - 8);
     strcpy(sltg->name_table.data + sltg->name_table.size + 8, name);
     sltg->name_table.size = new_size;
-    sltg->name_table.data[sltg->name_table.size - 1] = 0; /* clear alignment */
 
     return name_offset;
 }
@@ -320,6 +336,7 @@ static int add_name(struct sltg_typelib *sltg, const char *name)
 static void init_name_table(struct sltg_typelib *sltg)
 {
     init_sltg_data(&sltg->name_table);
+    memset(&sltg->name_offsets, 0, sizeof(sltg->name_offsets));
 }
 
 static void init_library(struct sltg_typelib *sltg)
@@ -388,29 +405,22 @@ static void add_block_index(struct sltg_typelib *sltg, void *data, int size, int
     block->index_string = index;
     block->next = NULL;
 
-    if (sltg->blocks)
-    {
-        struct sltg_block *blocks = sltg->blocks;
-
-        while (blocks->next)
-            blocks = blocks->next;
-
-        blocks->next = block;
-    }
+    if (sltg->last_block)
+        sltg->last_block->next = block;
     else
         sltg->blocks = block;
+    sltg->last_block = block;
 
     sltg->n_file_blocks++;
 }
 
 static void add_block(struct sltg_typelib *sltg, void *data, int size, const char *name)
 {
-    struct sltg_block *block = xmalloc(sizeof(*block));
     int index;
 
     chat("add_block: %p,%d,\"%s\"\n", data, size, name);
 
-    index = add_index(&sltg->index, name);
+    index = add_index(sltg, name);
 
     add_block_index(sltg, data, size, index);
 }
@@ -457,28 +467,36 @@ static void *create_library_block(struct sltg_typelib *typelib, int *size, int *
     p += 2;
     *(GUID *)p = typelib->library.uuid;
 
-    *index = add_index(&typelib->index, "dir");
+    *index = add_index(typelib, "dir");
 
     return block;
 }
 
+/* the block names keep counting across the typelibs of an input file */
+static char block_name[11] = "0000000000";
+static int block_name_pos;
+
+void reset_sltg_index_names(void)
+{
+    strcpy(block_name, "0000000000");
+    block_name_pos = 0;
+}
+
 static const char *new_index_name(void)
 {
-    static char name[11] = "0000000000";
-    static int pos = 0;
     char *new_name;
 
-    if (name[pos] == 'Z')
+    if (block_name[block_name_pos] == 'Z')
     {
-        pos++;
-        if (pos > 9)
+        block_name_pos++;
+        if (block_name_pos > 9)
             error("too many index names\n");
     }
 
-    name[pos]++;
+    block_name[block_name_pos]++;
 
-    new_name = xmalloc(sizeof(name));
-    strcpy(new_name, name);
+    new_name = xmalloc(sizeof(block_name));
+    strcpy(new_name, block_name);
     return new_name;
 }
 
@@ -493,17 +511,11 @@ static void sltg_add_typeinfo(struct sltg_typelib *sltg, void *data, int size, c
     block->index_string = 0;
     block->next = NULL;
 
-    if (sltg->typeinfo)
-    {
-        struct sltg_block *typeinfo = sltg->typeinfo;
-
-        while (typeinfo->next)
-            typeinfo = typeinfo->next;
-
-        typeinfo->next = block;
-    }
+    if (sltg->last_typeinfo)
+        sltg->last_typeinfo->next = block;
     else
         sltg->typeinfo = block;
+    sltg->last_typeinfo = block;
 
     sltg->typeinfo_count++;
     sltg->typeinfo_size += size;
@@ -994,12 +1006,12 @@ static void add_structure_typeinfo(struct sltg_typelib *typelib, type_t *type)
             short base_offset;
 
             chat("add_structure_typeinfo: var %p (%s), type %p (%s)\n",
-                 var, var->name, var->type, var->type->name);
+                 var, var->name, var->declspec.type, var->declspec.type->name);
 
             init_sltg_data(&var_data[i]);
 
             base_offset = var_data_size + (i + 1) * sizeof(struct sltg_variable);
-            type_desc_offset[i] = write_var_desc(typelib, &var_data[i], var->type, 0, 0,
+            type_desc_offset[i] = write_var_desc(typelib, &var_data[i], var->declspec.type, 0, 0,
                                                  base_offset, &size_instance, &hrefmap);
             dump_var_desc(var_data[i].data, var_data[i].size);
 
@@ -1081,27 +1093,6 @@ static void add_structure_typeinfo(struct sltg_typelib *typelib, type_t *type)
     add_block(typelib, data.data, data.size, index_name);
 }
 
-static importinfo_t *find_importinfo(typelib_t *typelib, const char *name)
-{
-    importlib_t *importlib;
-
-    LIST_FOR_EACH_ENTRY(importlib, &typelib->importlibs, importlib_t, entry)
-    {
-        int i;
-
-        for (i = 0; i < importlib->ntypeinfos; i++)
-        {
-            if (!strcmp(name, importlib->importinfos[i].name))
-            {
-                chat("Found %s in importlib list\n", name);
-                return &importlib->importinfos[i];
-            }
-        }
-    }
-
-    return NULL;
-}
-
 static int get_func_flags(const var_t *func, int *dispid, int *invokekind, int *helpcontext, const char **helpstring)
 {
     const attr_t *attr;
@@ -1245,7 +1236,7 @@ static int add_func_desc(struct sltg_typelib *typelib, struct sltg_data *data, v
     old_size = data->size;
 
     init_sltg_data(&ret_data);
-    ret_desc_offset = write_var_desc(typelib, &ret_data, type_function_get_rettype(func->type),
+    ret_desc_offset = write_var_desc(typelib, &ret_data, type_function_get_rettype(func->declspec.type),
                                      0, 0, base_offset, NULL, hrefmap);
     dump_var_desc(ret_data.data, ret_data.size);
 
@@ -1258,28 +1249,28 @@ static int add_func_desc(struct sltg_typelib *typelib, struct sltg_data *data, v
         arg_offset += ret_data.size;
     }
 
-    if (type_get_function_args(func->type))
+    if (type_function_get_args(func->declspec.type))
     {
         int i = 0;
 
-        arg_count = list_count(type_get_function_args(func->type));
+        arg_count = list_count(type_function_get_args(func->declspec.type));
 
         arg_data = xmalloc(arg_count * sizeof(*arg_data));
         arg_desc_offset = xmalloc(arg_count * sizeof(*arg_desc_offset));
 
         arg_offset += arg_count * 2 * sizeof(short);
 
-        LIST_FOR_EACH_ENTRY(arg, type_get_function_args(func->type), const var_t, entry)
+        LIST_FOR_EACH_ENTRY(arg, type_function_get_args(func->declspec.type), const var_t, entry)
         {
             const attr_t *attr;
             short param_flags = get_param_flags(arg);
 
             chat("add_func_desc: arg[%d] %p (%s), type %p (%s)\n",
-                 i, arg, arg->name, arg->type, arg->type->name);
+                 i, arg, arg->name, arg->declspec.type, arg->declspec.type->name);
 
             init_sltg_data(&arg_data[i]);
 
-            arg_desc_offset[i] = write_var_desc(typelib, &arg_data[i], arg->type, param_flags, 0,
+            arg_desc_offset[i] = write_var_desc(typelib, &arg_data[i], arg->declspec.type, param_flags, 0,
                                                 arg_offset, NULL, hrefmap);
             dump_var_desc(arg_data[i].data, arg_data[i].size);
 
@@ -1356,7 +1347,7 @@ static int add_func_desc(struct sltg_typelib *typelib, struct sltg_data *data, v
 
         arg_offset += arg_count * 2 * sizeof(short);
 
-        LIST_FOR_EACH_ENTRY(arg, type_get_function_args(func->type), const var_t, entry)
+        LIST_FOR_EACH_ENTRY(arg, type_function_get_args(func->declspec.type), const var_t, entry)
         {
             short name, type_offset;
 
@@ -1800,6 +1791,7 @@ static void save_all_changes(struct sltg_typelib *typelib)
     int library_block_start;
     int *name_table_offset;
 
+    init_output_buffer();
     sltg_write_header(typelib, &library_block_start);
     sltg_write_typeinfo(typelib);
 
@@ -1839,11 +1831,13 @@ int create_sltg_typelib(typelib_t *typelib)
     sltg.typeinfo_count = 0;
     sltg.typeinfo_size = 0;
     sltg.typeinfo = NULL;
+    sltg.last_typeinfo = NULL;
     sltg.blocks = NULL;
+    sltg.last_block = NULL;
     sltg.n_file_blocks = 0;
     sltg.first_block = 1;
 
-    init_index(&sltg.index);
+    init_index(&sltg);
     init_name_table(&sltg);
     init_library(&sltg);
 
@@ -1857,5 +1851,7 @@ int create_sltg_typelib(typelib_t *typelib)
 
     save_all_changes(&sltg);
 
+    symbol_table_free_copies(&sltg.index_offsets);
+    symbol_table_free_copies(&sltg.name_offsets);
     return 1;
 }